@@ -0,0 +1,272 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// Regression check against the json results of an earlier run. Results are
+// matched on queue, payload, scenario and thread counts. Throughput regresses
+// when its median drops, the round trip time when its median grows and the
+// latency scenario when its p99 grows, by more than the threshold. Results
+// missing on either side are skipped, e.g. a competing library that is not
+// installed on this machine.
+
+#ifndef DRO_BENCHMARK_BASELINE
+#define DRO_BENCHMARK_BASELINE
+
+#include "benchmark-harness.hpp"
+
+#include <cctype>
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// One baseline result, the string and number members of its json object
+struct BaselineEntry
+{
+  std::map<std::string, std::string> strings_;
+  std::map<std::string, double> numbers_;
+
+  [[nodiscard]] std::string key() const
+  {
+    return strings_.at("queue") + " (" +
+           std::to_string(static_cast<std::size_t>(
+               numbers_.at("payload_bytes"))) +
+           " bytes) " + strings_.at("scenario") + " " +
+           std::to_string(static_cast<std::size_t>(numbers_.at("producers"))) +
+           "P " +
+           std::to_string(static_cast<std::size_t>(numbers_.at("consumers"))) +
+           "C";
+  }
+};
+
+// Reads the array of flat objects written by ResultPrinter::writeJson
+class BaselineReader
+{
+private:
+  std::string text_;
+  std::size_t pos_ {};
+
+  void skipSpace()
+  {
+    while (pos_ < text_.size() &&
+           std::isspace(static_cast<unsigned char>(text_[pos_])))
+    {
+      ++pos_;
+    }
+  }
+
+  [[nodiscard]] bool consume(char c)
+  {
+    skipSpace();
+    if (pos_ < text_.size() && text_[pos_] == c)
+    {
+      ++pos_;
+      return true;
+    }
+    return false;
+  }
+
+  void expect(char c)
+  {
+    if (! consume(c))
+    {
+      throw std::runtime_error("Baseline json expected '" + std::string(1, c) +
+                               "' at offset " + std::to_string(pos_));
+    }
+  }
+
+  [[nodiscard]] std::string readString()
+  {
+    expect('"');
+    std::string value;
+    while (pos_ < text_.size() && text_[pos_] != '"')
+    {
+      if (text_[pos_] == '\\' && pos_ + 1 < text_.size())
+      {
+        ++pos_;
+      }
+      value += text_[pos_++];
+    }
+    expect('"');
+    return value;
+  }
+
+  [[nodiscard]] double readNumber()
+  {
+    skipSpace();
+    std::size_t length {};
+    auto const value = std::stod(text_.substr(pos_), &length);
+    pos_ += length;
+    return value;
+  }
+
+  void skipArray()
+  {
+    expect('[');
+    if (consume(']'))
+    {
+      return;
+    }
+    do
+    {
+      static_cast<void>(readNumber());
+    } while (consume(','));
+    expect(']');
+  }
+
+  [[nodiscard]] BaselineEntry readEntry()
+  {
+    BaselineEntry entry;
+    expect('{');
+    if (consume('}'))
+    {
+      return entry;
+    }
+    do
+    {
+      auto key = readString();
+      expect(':');
+      skipSpace();
+      if (pos_ < text_.size() && text_[pos_] == '"')
+      {
+        entry.strings_[std::move(key)] = readString();
+      }
+      else if (pos_ < text_.size() && text_[pos_] == '[')
+      {
+        skipArray();
+      }
+      else
+      {
+        entry.numbers_[std::move(key)] = readNumber();
+      }
+    } while (consume(','));
+    expect('}');
+    return entry;
+  }
+
+public:
+  explicit BaselineReader(std::string text) : text_(std::move(text)) {}
+
+  [[nodiscard]] std::vector<BaselineEntry> read()
+  {
+    std::vector<BaselineEntry> entries;
+    expect('[');
+    if (consume(']'))
+    {
+      return entries;
+    }
+    do
+    {
+      entries.push_back(readEntry());
+    } while (consume(','));
+    expect(']');
+    return entries;
+  }
+};
+
+inline std::vector<BaselineEntry> readBaseline(const std::string& path)
+{
+  std::ifstream file(path);
+  if (! file)
+  {
+    throw std::runtime_error("Cannot open baseline " + path +
+                             ", record one with --output");
+  }
+  std::stringstream text;
+  text << file.rdbuf();
+  return BaselineReader(text.str()).read();
+}
+
+// Returns the number of results worse than the baseline by more than
+// thresholdPercent, every regression is reported on log
+inline std::size_t checkRegressions(const std::vector<Result>& results,
+                                    const std::vector<BaselineEntry>& baseline,
+                                    double thresholdPercent, std::ostream& log)
+{
+  std::map<std::string, const BaselineEntry*> entries;
+  for (auto const& entry : baseline) { entries[entry.key()] = &entry; }
+
+  std::size_t compared {};
+  std::size_t regressions {};
+  for (auto const& result : results)
+  {
+    BaselineEntry current;
+    current.strings_ = {{"queue", result.queue_},
+                        {"scenario", result.scenario_}};
+    current.numbers_ = {
+        {"payload_bytes", static_cast<double>(result.payload_)},
+        {"producers", static_cast<double>(result.producers_)},
+        {"consumers", static_cast<double>(result.consumers_)}};
+    auto const found = entries.find(current.key());
+    if (found == entries.end())
+    {
+      continue;
+    }
+    auto const& numbers = found->second->numbers_;
+    auto const metric   = result.latency_ ? "p99_ns" : "median";
+    auto const stored   = numbers.find(metric);
+    if (stored == numbers.end() || stored->second <= 0)
+    {
+      continue;
+    }
+    auto const value =
+        static_cast<double>(result.latency_ ? result.latency_->percentile(99)
+                                            : result.median());
+    // Throughput is better when higher, times when lower
+    auto const higherIsBetter = ! result.latency_ && result.unit_ == "ops/ms";
+    auto const change = (value - stored->second) / stored->second * 100.0;
+    auto const worse  = higherIsBetter ? -change : change;
+    ++compared;
+    if (worse > thresholdPercent)
+    {
+      ++regressions;
+      log << "Regression: " << found->first << " " << metric << " "
+          << stored->second << " -> " << value << " " << result.unit_ << " ("
+          << worse << "% worse)\n";
+    }
+  }
+  log << regressions << " of " << compared
+      << " results regressed past the threshold of " << thresholdPercent
+      << "%\n";
+  return regressions;
+}
+
+// Read before the run, a missing baseline fails before the matrix is run
+inline std::optional<std::vector<BaselineEntry>>
+loadBaseline(const Options& options)
+{
+  if (options.baseline_.empty())
+  {
+    return std::nullopt;
+  }
+  return readBaseline(options.baseline_);
+}
+
+// Writes the json results and checks them against the baseline. Returns the
+// exit code, 2 when a result regressed.
+inline int finishRun(const Options& options, const ResultPrinter& printer,
+                     const std::optional<std::vector<BaselineEntry>>& baseline)
+{
+  if (! options.output_.empty())
+  {
+    std::ofstream file(options.output_);
+    printer.writeJson(file);
+    if (! file)
+    {
+      throw std::runtime_error("Cannot write " + options.output_);
+    }
+  }
+  if (! baseline)
+  {
+    return 0;
+  }
+  return checkRegressions(printer.results(), *baseline, options.threshold_,
+                          std::cerr) == 0
+             ? 0
+             : 2;
+}
+
+#endif
@@ -0,0 +1,1219 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// Data driven benchmark harness. Scenarios are templated over a queue adapter
+// (see queue-adapters.hpp) and configured from the command line, results are
+// printed as text, csv or json.
+
+#ifndef DRO_BENCHMARK_HARNESS
+#define DRO_BENCHMARK_HARNESS
+
+#include "dro/pin-thread.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <concepts>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#if __has_include(<linux/perf_event.h>)
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using dro::pinThread;
+
+// Alignas powers of 2 for convenient testing of various sizes
+template <std::size_t N> struct alignas(N) Payload
+{
+  int x_;
+  Payload() = default;
+  Payload(int x) : x_(x) {}
+};
+
+// Payload sizes matching benchmarks/results/
+inline constexpr std::array<std::size_t, 7> payloadSizes {4,  8,   16, 32,
+                                                          64, 128, 256};
+
+template <typename F> void dispatchPayload(std::size_t size, F&& func)
+{
+  switch (size)
+  {
+  case 4: func.template operator()<Payload<4>>(); break;
+  case 8: func.template operator()<Payload<8>>(); break;
+  case 16: func.template operator()<Payload<16>>(); break;
+  case 32: func.template operator()<Payload<32>>(); break;
+  case 64: func.template operator()<Payload<64>>(); break;
+  case 128: func.template operator()<Payload<128>>(); break;
+  case 256: func.template operator()<Payload<256>>(); break;
+  default: throw std::invalid_argument("Unsupported payload size");
+  }
+}
+
+// Timestamps taken with rdtsc where available, calibrated once against
+// steady_clock, otherwise steady_clock nanoseconds
+struct TscClock
+{
+  [[nodiscard]] static std::uint64_t now() noexcept
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+  }
+
+  [[nodiscard]] static double nanosecondsPerTick()
+  {
+    static const double nsPerTick = [] {
+      auto const startTicks = now();
+      auto const start      = std::chrono::steady_clock::now();
+      while (std::chrono::steady_clock::now() - start <
+             std::chrono::milliseconds(50))
+      {
+      }
+      auto const stopTicks = now();
+      auto const stop      = std::chrono::steady_clock::now();
+      return static_cast<double>(
+                 std::chrono::duration_cast<std::chrono::nanoseconds>(stop -
+                                                                      start)
+                     .count()) /
+             static_cast<double>(stopTicks - startTicks);
+    }();
+    return nsPerTick;
+  }
+};
+
+// Log linear histogram in the style of HdrHistogram. Every power of two range
+// is split into 2^SUB_BITS buckets, a recorded value is off by at most 1/32.
+class LatencyHistogram
+{
+private:
+  static constexpr std::size_t SUB_BITS    = 5;
+  static constexpr std::size_t SUB_BUCKETS = 1 << SUB_BITS;
+  static constexpr std::size_t BUCKETS     = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+  std::vector<std::uint64_t> counts_ = std::vector<std::uint64_t>(BUCKETS);
+  std::uint64_t total_ {};
+  std::uint64_t max_ {};
+
+  [[nodiscard]] static std::size_t bucket(std::uint64_t value) noexcept
+  {
+    if (value < SUB_BUCKETS)
+    {
+      return value;
+    }
+    auto const shift = std::bit_width(value) - SUB_BITS - 1;
+    return (shift + 1) * SUB_BUCKETS + (value >> shift) - SUB_BUCKETS;
+  }
+
+  // Largest value that maps to the bucket
+  [[nodiscard]] static std::uint64_t upperBound(std::size_t index) noexcept
+  {
+    if (index < SUB_BUCKETS)
+    {
+      return index;
+    }
+    auto const shift = index / SUB_BUCKETS - 1;
+    return (((index % SUB_BUCKETS + SUB_BUCKETS) + 1) << shift) - 1;
+  }
+
+public:
+  void record(std::uint64_t value) noexcept
+  {
+    ++counts_[bucket(value)];
+    ++total_;
+    max_ = std::max(max_, value);
+  }
+
+  [[nodiscard]] std::uint64_t percentile(double percent) const noexcept
+  {
+    auto const target = std::max<std::uint64_t>(
+        static_cast<std::uint64_t>(
+            std::ceil(percent / 100.0 * static_cast<double>(total_))),
+        1);
+    std::uint64_t seen {};
+    for (std::size_t i {}; i < BUCKETS; ++i)
+    {
+      seen += counts_[i];
+      if (seen >= target)
+      {
+        return std::min(upperBound(i), max_);
+      }
+    }
+    return max_;
+  }
+
+  [[nodiscard]] std::uint64_t count() const noexcept { return total_; }
+
+  [[nodiscard]] std::uint64_t max() const noexcept { return max_; }
+};
+
+// Cache misses read with perf_event_open. The counters follow the calling
+// thread and every thread it creates afterwards, so they are opened before
+// the worker threads start and read after they join.
+class PerfCounters
+{
+public:
+  static constexpr std::size_t COUNTERS = 2;
+  static constexpr std::array<const char*, COUNTERS> names {
+      "l1d_misses_per_op", "llc_misses_per_op"};
+
+private:
+  std::array<int, COUNTERS> fds_ {-1, -1};
+
+#if __has_include(<linux/perf_event.h>)
+  static int open(std::uint32_t type, std::uint64_t config)
+  {
+    perf_event_attr attr {};
+    attr.size           = sizeof(attr);
+    attr.type           = type;
+    attr.config         = config;
+    attr.disabled       = 1;
+    attr.inherit        = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    auto const fd = static_cast<int>(
+        syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+    if (fd < 0)
+    {
+      throw std::runtime_error(
+          std::string("perf_event_open failed: ") + std::strerror(errno) +
+          ", check /proc/sys/kernel/perf_event_paranoid");
+    }
+    return fd;
+  }
+#endif
+
+public:
+  PerfCounters()
+  {
+#if __has_include(<linux/perf_event.h>)
+    try
+    {
+      fds_[0] = open(PERF_TYPE_HW_CACHE,
+                     PERF_COUNT_HW_CACHE_L1D |
+                         (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+      fds_[1] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    }
+    catch (...)
+    {
+      close();
+      throw;
+    }
+#else
+    throw std::runtime_error("Hardware counters need linux/perf_event.h");
+#endif
+  }
+
+  PerfCounters(const PerfCounters&)            = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+  ~PerfCounters() { close(); }
+
+  void close() noexcept
+  {
+#if __has_include(<linux/perf_event.h>)
+    for (auto& fd : fds_)
+    {
+      if (fd >= 0)
+      {
+        ::close(fd);
+        fd = -1;
+      }
+    }
+#endif
+  }
+
+  void start() noexcept
+  {
+#if __has_include(<linux/perf_event.h>)
+    for (auto fd : fds_)
+    {
+      ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+  }
+
+  void stop() noexcept
+  {
+#if __has_include(<linux/perf_event.h>)
+    for (auto fd : fds_) { ioctl(fd, PERF_EVENT_IOC_DISABLE, 0); }
+#endif
+  }
+
+  // Counts scaled up for the time the counter was multiplexed out
+  [[nodiscard]] std::array<double, COUNTERS> read() const noexcept
+  {
+    std::array<double, COUNTERS> counts {};
+#if __has_include(<linux/perf_event.h>)
+    for (std::size_t i {}; i < COUNTERS; ++i)
+    {
+      std::array<std::uint64_t, 3> value {};
+      if (::read(fds_[i], value.data(), sizeof(value)) ==
+              static_cast<ssize_t>(sizeof(value)) &&
+          value[2] != 0)
+      {
+        counts[i] = static_cast<double>(value[0]) *
+                    static_cast<double>(value[1]) /
+                    static_cast<double>(value[2]);
+      }
+    }
+#endif
+    return counts;
+  }
+};
+
+struct ThreadConfig
+{
+  std::size_t producers_ {1};
+  std::size_t consumers_ {1};
+
+  bool operator==(const ThreadConfig&) const = default;
+};
+
+struct Options
+{
+  // Producer x consumer counts of the throughput and bulk scenarios
+  std::vector<ThreadConfig> threads_ {{1, 1}, {2, 2}};
+  std::vector<std::size_t> sizes_ {4};
+  std::vector<std::string> scenarios_ {"throughput", "rtt"};
+  // Substrings of the queue names to run, empty runs every queue
+  std::vector<std::string> queues_;
+  // Worker threads are pinned in creation order, consumer before producer
+  std::vector<int> cpus_;
+  std::size_t capacity_ {10'000'000};
+  std::size_t iters_ {10'000'000};
+  std::size_t trials_ {7};
+  // Discarded runs before the measured trials
+  std::size_t warmup_ {0};
+  std::size_t batch_ {32};
+  std::size_t latencyIters_ {1'000'000};
+  // Producer pacing of the latency scenario, keeps the queue near empty so the
+  // histogram measures the hand off rather than the queueing delay
+  std::chrono::nanoseconds latencyInterval_ {1'000};
+  std::string format_ {"text"};
+  // Cache misses per operation of the throughput and rtt scenarios
+  bool counters_ {false};
+  // Json results are also written here, regardless of the format
+  std::string output_;
+  // Json results of an earlier run to check for regressions
+  std::string baseline_;
+  // Percentage a result may be worse than the baseline
+  double threshold_ {10.0};
+
+  [[nodiscard]] int cpu(std::size_t thread) const noexcept
+  {
+    return cpus_.empty() ? -1 : cpus_[thread % cpus_.size()];
+  }
+
+  [[nodiscard]] bool selected(std::string_view name) const
+  {
+    return queues_.empty() ||
+           std::any_of(queues_.begin(), queues_.end(), [&](auto const& q) {
+             return name.find(q) != std::string_view::npos;
+           });
+  }
+
+  [[nodiscard]] bool scenario(std::string_view name) const
+  {
+    return std::find(scenarios_.begin(), scenarios_.end(), name) !=
+           scenarios_.end();
+  }
+};
+
+inline std::vector<std::string> splitList(std::string_view list)
+{
+  std::vector<std::string> items;
+  std::stringstream stream {std::string(list)};
+  for (std::string item; std::getline(stream, item, ',');)
+  {
+    if (! item.empty())
+    {
+      items.push_back(item);
+    }
+  }
+  return items;
+}
+
+// Cpus listed by the isolcpus kernel parameter, e.g. "2-3,6"
+inline std::vector<int> isolatedCpus()
+{
+  std::vector<int> cpus;
+  std::ifstream file("/sys/devices/system/cpu/isolated");
+  std::string list;
+  if (! std::getline(file, list))
+  {
+    return cpus;
+  }
+  for (auto const& item : splitList(list))
+  {
+    auto const separator = item.find('-');
+    auto const first     = std::stoi(item.substr(0, separator));
+    auto const last      = separator == std::string::npos
+                               ? first
+                               : std::stoi(item.substr(separator + 1));
+    for (int cpu {first}; cpu <= last; ++cpu) { cpus.push_back(cpu); }
+  }
+  return cpus;
+}
+
+// Without --cpus the worker threads are pinned to the isolated cpus when there
+// are at least two. Pinned cpus that are not isolated share their core with
+// other tasks and are reported, their results are noisy.
+inline void selectIsolatedCpus(Options& options)
+{
+  auto const isolated = isolatedCpus();
+  if (options.cpus_.empty())
+  {
+    if (isolated.size() >= 2)
+    {
+      options.cpus_ = isolated;
+    }
+    else
+    {
+      std::cerr << "Fewer than two isolated cpus, threads are not pinned\n";
+    }
+    return;
+  }
+  for (auto const cpu : options.cpus_)
+  {
+    if (std::find(isolated.begin(), isolated.end(), cpu) == isolated.end())
+    {
+      std::cerr << "Cpu " << cpu << " is not isolated\n";
+    }
+  }
+}
+
+inline void printUsage(const char* program)
+{
+  std::cout
+      << "Usage: " << program << " [options] [cpu1 cpu2 cpu3 cpu4]\n"
+      << "  --scenarios LIST  throughput,rtt,bulk,contention,latency\n"
+      << "                    (throughput,rtt)\n"
+      << "  --threads LIST    producers x consumers, e.g. 1x1,2x2,4x4\n"
+      << "  --sizes LIST      payload bytes of 4,8,16,32,64,128,256 (4)\n"
+      << "  --queues LIST     substrings of the queue names to run (all)\n"
+      << "  --cpus LIST       cpus to pin the worker threads to (none)\n"
+      << "  --capacity N      queue capacity (10000000)\n"
+      << "  --iters N         operations per producer (10000000)\n"
+      << "  --trials N        trials per measurement (7)\n"
+      << "  --warmup N        discarded runs before the trials (0)\n"
+      << "  --batch N         batch size of the bulk scenario (32)\n"
+      << "  --latency-iters N messages of the latency scenario (1000000)\n"
+      << "  --interval NS     producer pacing of the latency scenario (1000)\n"
+      << "  --format FORMAT   text, csv or json (text)\n"
+      << "  --counters        L1d and LLC misses per op, needs perf events\n"
+      << "  --latency FORMAT  same as --scenarios latency --format FORMAT\n"
+      << "  --output FILE     also write the json results to FILE\n"
+      << "  --baseline FILE   exit with 2 if a result regressed against the\n"
+      << "                    json results in FILE\n"
+      << "  --threshold PCT   allowed regression in percent (10)\n"
+      << "Without --cpus the worker threads are pinned to the isolated cpus\n"
+      << "when there are at least two.\n";
+}
+
+inline Options parseOptions(int argc, char* argv[])
+{
+  Options options;
+  std::vector<int> positionalCpus;
+  for (int i {1}; i < argc; ++i)
+  {
+    std::string_view const arg = argv[i];
+    if (arg == "--help" || arg == "-h")
+    {
+      printUsage(argv[0]);
+      exit(0);
+    }
+    if (! arg.starts_with("--"))
+    {
+      positionalCpus.push_back(std::stoi(argv[i]));
+      continue;
+    }
+    if (arg == "--counters")
+    {
+      options.counters_ = true;
+      continue;
+    }
+    if (i + 1 >= argc)
+    {
+      throw std::invalid_argument("Missing value for " + std::string(arg));
+    }
+    std::string_view const value = argv[++i];
+    auto const number            = [&] { return std::stoul(argv[i]); };
+    if (arg == "--latency")
+    {
+      options.scenarios_ = {"latency"};
+      options.format_    = value;
+    }
+    else if (arg == "--scenarios")
+    {
+      options.scenarios_ = splitList(value);
+    }
+    else if (arg == "--threads")
+    {
+      options.threads_.clear();
+      for (auto const& item : splitList(value))
+      {
+        auto const separator = item.find('x');
+        if (separator == std::string::npos)
+        {
+          throw std::invalid_argument("Threads must be PxC, e.g. 2x2");
+        }
+        options.threads_.push_back({std::stoul(item.substr(0, separator)),
+                                    std::stoul(item.substr(separator + 1))});
+      }
+    }
+    else if (arg == "--sizes")
+    {
+      options.sizes_.clear();
+      for (auto const& item : splitList(value))
+      {
+        options.sizes_.push_back(std::stoul(item));
+      }
+    }
+    else if (arg == "--queues")
+    {
+      options.queues_ = splitList(value);
+    }
+    else if (arg == "--cpus")
+    {
+      options.cpus_.clear();
+      for (auto const& item : splitList(value))
+      {
+        options.cpus_.push_back(std::stoi(item));
+      }
+    }
+    else if (arg == "--capacity")
+    {
+      options.capacity_ = number();
+    }
+    else if (arg == "--iters")
+    {
+      options.iters_ = number();
+    }
+    else if (arg == "--trials")
+    {
+      options.trials_ = number();
+    }
+    else if (arg == "--warmup")
+    {
+      options.warmup_ = number();
+    }
+    else if (arg == "--output")
+    {
+      options.output_ = value;
+    }
+    else if (arg == "--baseline")
+    {
+      options.baseline_ = value;
+    }
+    else if (arg == "--threshold")
+    {
+      options.threshold_ = std::stod(argv[i]);
+    }
+    else if (arg == "--batch")
+    {
+      options.batch_ = number();
+    }
+    else if (arg == "--latency-iters")
+    {
+      options.latencyIters_ = number();
+    }
+    else if (arg == "--interval")
+    {
+      options.latencyInterval_ = std::chrono::nanoseconds(number());
+    }
+    else if (arg == "--format")
+    {
+      options.format_ = value;
+    }
+    else
+    {
+      throw std::invalid_argument("Unknown option " + std::string(arg));
+    }
+  }
+  // Legacy positional cpus, consumer, producer, consumer, producer
+  if (! positionalCpus.empty())
+  {
+    options.cpus_ = positionalCpus;
+  }
+  if (options.trials_ < 1 || options.batch_ < 1)
+  {
+    throw std::invalid_argument("Trials and batch must be positive");
+  }
+  if (options.threshold_ < 0)
+  {
+    throw std::invalid_argument("Threshold cannot be negative");
+  }
+  selectIsolatedCpus(options);
+  return options;
+}
+
+struct Result
+{
+  std::string queue_;
+  std::size_t payload_ {};
+  std::string scenario_;
+  std::size_t producers_ {};
+  std::size_t consumers_ {};
+  std::string unit_;
+  // One measurement per trial, sorted
+  std::vector<std::size_t> trials_;
+  std::optional<LatencyHistogram> latency_;
+  std::size_t capacity_ {};
+  std::size_t memory_ {};
+  // Per operation over every trial, in the order of PerfCounters::names
+  std::optional<std::array<double, PerfCounters::COUNTERS>> counters_;
+
+  [[nodiscard]] std::size_t mean() const noexcept
+  {
+    return trials_.empty() ? 0
+                           : std::accumulate(trials_.begin(), trials_.end(),
+                                             std::size_t {}) /
+                                 trials_.size();
+  }
+
+  [[nodiscard]] std::size_t median() const noexcept
+  {
+    return trials_.empty() ? 0 : trials_[trials_.size() / 2];
+  }
+};
+
+inline constexpr std::array<double, 5> latencyPercentiles {50, 90, 99, 99.9,
+                                                           99.99};
+inline constexpr std::array<const char*, 5> latencyPercentileNames {
+    "p50_ns", "p90_ns", "p99_ns", "p99.9_ns", "p99.99_ns"};
+
+// Text and csv rows are printed as results arrive, json when finished
+class ResultPrinter
+{
+private:
+  std::string format_;
+  std::vector<Result> results_;
+  std::string lastQueue_;
+
+  void printText(const Result& result)
+  {
+    auto const queue =
+        result.queue_ + " (" + std::to_string(result.payload_) + " bytes)";
+    if (queue != lastQueue_)
+    {
+      std::cout << queue << ": \n";
+      lastQueue_ = queue;
+    }
+    if (result.latency_)
+    {
+      auto const& histogram = *result.latency_;
+      std::cout << "Latency:";
+      for (std::size_t i {}; i < latencyPercentiles.size(); ++i)
+      {
+        std::cout << " " << latencyPercentileNames[i] << " "
+                  << histogram.percentile(latencyPercentiles[i]);
+      }
+      std::cout << " max_ns " << histogram.max() << "\n";
+      return;
+    }
+    auto label = " " + result.unit_;
+    if (result.scenario_ != "rtt")
+    {
+      label += " - " + std::to_string(result.producers_) + "P " +
+               std::to_string(result.consumers_) + "C";
+    }
+    if (result.scenario_ != "throughput" && result.scenario_ != "rtt")
+    {
+      label += " " + result.scenario_;
+    }
+    std::cout << "Mean: " << result.mean() << label << "\n";
+    std::cout << "Median: " << result.median() << label << "\n";
+    if (result.counters_)
+    {
+      std::cout << "Counters:";
+      for (std::size_t i {}; i < PerfCounters::COUNTERS; ++i)
+      {
+        std::cout << " " << PerfCounters::names[i] << " "
+                  << (*result.counters_)[i];
+      }
+      std::cout << "\n";
+    }
+    if (result.memory_)
+    {
+      std::cout << "Memory: " << result.memory_ / (1024 * 1024) << " MiB - "
+                << result.memory_ / result.capacity_ << " bytes per slot\n";
+    }
+  }
+
+  static void printCsvHeader()
+  {
+    std::cout << "queue,payload_bytes,scenario,producers,consumers,unit,mean,"
+                 "median";
+    for (auto const* name : latencyPercentileNames)
+    {
+      std::cout << "," << name;
+    }
+    std::cout << ",max_ns,capacity,memory_bytes";
+    for (auto const* name : PerfCounters::names)
+    {
+      std::cout << "," << name;
+    }
+    std::cout << "\n";
+  }
+
+  static void printCsv(const Result& result)
+  {
+    // Queue names contain commas
+    std::cout << "\"" << result.queue_ << "\"," << result.payload_ << ","
+              << result.scenario_ << "," << result.producers_ << ","
+              << result.consumers_ << "," << result.unit_ << ",";
+    if (! result.trials_.empty())
+    {
+      std::cout << result.mean() << "," << result.median();
+    }
+    else
+    {
+      std::cout << ",";
+    }
+    for (auto percent : latencyPercentiles)
+    {
+      std::cout << ",";
+      if (result.latency_)
+      {
+        std::cout << result.latency_->percentile(percent);
+      }
+    }
+    std::cout << ",";
+    if (result.latency_)
+    {
+      std::cout << result.latency_->max();
+    }
+    std::cout << "," << result.capacity_ << "," << result.memory_;
+    for (std::size_t i {}; i < PerfCounters::COUNTERS; ++i)
+    {
+      std::cout << ",";
+      if (result.counters_)
+      {
+        std::cout << (*result.counters_)[i];
+      }
+    }
+    std::cout << "\n";
+  }
+
+  static void printJson(std::ostream& out, const Result& result, bool last)
+  {
+    out << "  {\"queue\": \"" << result.queue_
+              << "\", \"payload_bytes\": " << result.payload_
+              << ", \"scenario\": \"" << result.scenario_
+              << "\", \"producers\": " << result.producers_
+              << ", \"consumers\": " << result.consumers_ << ", \"unit\": \""
+              << result.unit_ << "\"";
+    if (! result.trials_.empty())
+    {
+      out << ", \"mean\": " << result.mean()
+                << ", \"median\": " << result.median() << ", \"trials\": [";
+      for (std::size_t i {}; i < result.trials_.size(); ++i)
+      {
+        out << (i ? ", " : "") << result.trials_[i];
+      }
+      out << "]";
+    }
+    if (result.latency_)
+    {
+      out << ", \"count\": " << result.latency_->count();
+      for (std::size_t i {}; i < latencyPercentiles.size(); ++i)
+      {
+        out << ", \"" << latencyPercentileNames[i] << "\": "
+                  << result.latency_->percentile(latencyPercentiles[i]);
+      }
+      out << ", \"max_ns\": " << result.latency_->max();
+    }
+    if (result.counters_)
+    {
+      for (std::size_t i {}; i < PerfCounters::COUNTERS; ++i)
+      {
+        out << ", \"" << PerfCounters::names[i]
+                  << "\": " << (*result.counters_)[i];
+      }
+    }
+    out << ", \"capacity\": " << result.capacity_
+              << ", \"memory_bytes\": " << result.memory_ << "}"
+              << (last ? "" : ",") << "\n";
+  }
+
+public:
+  explicit ResultPrinter(std::string format) : format_(std::move(format))
+  {
+    if (format_ != "text" && format_ != "csv" && format_ != "json")
+    {
+      throw std::invalid_argument("Format must be text, csv or json");
+    }
+    if (format_ == "csv")
+    {
+      printCsvHeader();
+    }
+  }
+
+  void print(Result result)
+  {
+    if (format_ == "text")
+    {
+      printText(result);
+    }
+    else if (format_ == "csv")
+    {
+      printCsv(result);
+    }
+    results_.push_back(std::move(result));
+    std::cout.flush();
+  }
+
+  void finish()
+  {
+    if (format_ == "json")
+    {
+      writeJson(std::cout);
+    }
+  }
+
+  void writeJson(std::ostream& out) const
+  {
+    out << "[\n";
+    for (std::size_t i {}; i < results_.size(); ++i)
+    {
+      printJson(out, results_[i], i + 1 == results_.size());
+    }
+    out << "]\n";
+  }
+
+  [[nodiscard]] const std::vector<Result>& results() const noexcept
+  {
+    return results_;
+  }
+};
+
+template <typename A>
+concept QueueAdapter =
+    std::constructible_from<A, std::size_t, std::size_t> &&
+    requires(A& a, typename A::value_type& v) {
+      a.push(v);
+      { a.try_pop(v) } -> std::same_as<bool>;
+    };
+
+template <typename A>
+concept TryQueueAdapter =
+    QueueAdapter<A> && requires(A& a, typename A::value_type& v) {
+      { a.try_push(v) } -> std::same_as<bool>;
+    };
+
+template <typename A>
+concept BulkQueueAdapter =
+    QueueAdapter<A> && requires(A& a, typename A::value_type* p) {
+      a.push_bulk(p, p);
+      { a.try_pop_bulk(p, std::size_t {}) } -> std::same_as<std::size_t>;
+    };
+
+// Adapters may restrict the number of threads on either side
+template <typename A> constexpr std::size_t maxProducers() noexcept
+{
+  if constexpr (requires { A::max_producers; })
+  {
+    return A::max_producers;
+  }
+  else
+  {
+    return std::numeric_limits<std::size_t>::max();
+  }
+}
+
+template <typename A> constexpr std::size_t maxConsumers() noexcept
+{
+  if constexpr (requires { A::max_consumers; })
+  {
+    return A::max_consumers;
+  }
+  else
+  {
+    return std::numeric_limits<std::size_t>::max();
+  }
+}
+
+template <typename A> std::size_t memoryFootprint(const A& adapter)
+{
+  if constexpr (requires { adapter.memory(); })
+  {
+    return adapter.memory();
+  }
+  else
+  {
+    return 0;
+  }
+}
+
+// Blocking push / spinning try_pop, bulk calls or spinning try calls on both
+// sides. The contention scenario uses Try with a small capacity so that most
+// calls fail and the index and slot cache lines bounce between the threads.
+enum class Transfer
+{
+  Blocking,
+  Bulk,
+  Try
+};
+
+template <QueueAdapter Adapter>
+void produce(Adapter& queue, std::size_t count, std::size_t batch,
+             Transfer transfer)
+{
+  using T = typename Adapter::value_type;
+  if constexpr (TryQueueAdapter<Adapter>)
+  {
+    if (transfer == Transfer::Try)
+    {
+      for (std::size_t i {}; i < count; ++i)
+      {
+        T val(static_cast<int>(i));
+        while (! queue.try_push(val)) {}
+      }
+      return;
+    }
+  }
+  if constexpr (BulkQueueAdapter<Adapter>)
+  {
+    if (transfer == Transfer::Bulk)
+    {
+      std::vector<T> values(batch);
+      for (std::size_t i {}; i < count; i += batch)
+      {
+        auto const n = std::min(batch, count - i);
+        for (std::size_t j {}; j < n; ++j)
+        {
+          values[j] = T(static_cast<int>(i + j));
+        }
+        queue.push_bulk(values.data(), values.data() + n);
+      }
+      return;
+    }
+  }
+  for (std::size_t i {}; i < count; ++i)
+  {
+    T val(static_cast<int>(i));
+    queue.push(val);
+  }
+}
+
+template <QueueAdapter Adapter>
+void consume(Adapter& queue, std::size_t count, std::size_t batch,
+             Transfer transfer)
+{
+  using T = typename Adapter::value_type;
+  if constexpr (BulkQueueAdapter<Adapter>)
+  {
+    if (transfer == Transfer::Bulk)
+    {
+      std::vector<T> values(batch);
+      for (std::size_t i {}; i < count;)
+      {
+        i += queue.try_pop_bulk(values.data(), std::min(batch, count - i));
+      }
+      return;
+    }
+  }
+  T val;
+  for (std::size_t i {}; i < count; ++i)
+  {
+    while (! queue.try_pop(val)) {}
+  }
+}
+
+inline void addCounts(std::array<double, PerfCounters::COUNTERS>& sum,
+                      const std::array<double, PerfCounters::COUNTERS>& counts)
+{
+  for (std::size_t i {}; i < PerfCounters::COUNTERS; ++i)
+  {
+    sum[i] += counts[i];
+  }
+}
+
+inline std::array<double, PerfCounters::COUNTERS>
+perOperation(std::array<double, PerfCounters::COUNTERS> counts,
+             std::size_t operations)
+{
+  for (auto& count : counts) { count /= static_cast<double>(operations); }
+  return counts;
+}
+
+// Every producer pushes iters elements which are shared by the consumers, the
+// throughput counts every element moved through the queue
+template <QueueAdapter Adapter>
+Result runThroughput(const Options& options, std::string_view name,
+                     std::string_view scenario, ThreadConfig config,
+                     Transfer transfer)
+{
+  Result result {std::string(name),
+                 sizeof(typename Adapter::value_type),
+                 std::string(scenario),
+                 config.producers_,
+                 config.consumers_,
+                 "ops/ms"};
+  result.capacity_       = options.capacity_;
+  auto const threadCount = std::max(config.producers_, config.consumers_);
+  auto const total       = options.iters_ * config.producers_;
+  std::array<double, PerfCounters::COUNTERS> misses {};
+  for (std::size_t trial {}; trial < options.warmup_ + options.trials_;
+       ++trial)
+  {
+    Adapter queue(options.capacity_, threadCount);
+    result.memory_ = memoryFootprint(queue);
+    std::optional<PerfCounters> counters;
+    if (options.counters_)
+    {
+      counters.emplace();
+    }
+    std::atomic<bool> flag(false);
+    std::vector<std::thread> threads;
+    for (std::size_t i {}; i < threadCount; ++i)
+    {
+      if (i < config.consumers_)
+      {
+        auto const count = total / config.consumers_ +
+                           (i < total % config.consumers_ ? 1 : 0);
+        threads.emplace_back(
+            [&, count, cpu = options.cpu(threads.size())]() {
+              pinThread(cpu);
+              while (! flag) {}
+              consume(queue, count, options.batch_, transfer);
+            });
+      }
+      if (i < config.producers_)
+      {
+        threads.emplace_back([&, cpu = options.cpu(threads.size())]() {
+          pinThread(cpu);
+          while (! flag) {}
+          produce(queue, options.iters_, options.batch_, transfer);
+        });
+      }
+    }
+
+    if (counters)
+    {
+      counters->start();
+    }
+    auto start = std::chrono::steady_clock::now();
+    flag       = true;
+    for (auto& thrd : threads) { thrd.join(); }
+    auto stop = std::chrono::steady_clock::now();
+    if (trial < options.warmup_)
+    {
+      continue;
+    }
+    if (counters)
+    {
+      counters->stop();
+      addCounts(misses, counters->read());
+    }
+
+    result.trials_.push_back(
+        total * 1'000'000 /
+        std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start)
+            .count());
+  }
+  std::sort(result.trials_.begin(), result.trials_.end());
+  if (options.counters_)
+  {
+    result.counters_ = perOperation(misses, total * options.trials_);
+  }
+  return result;
+}
+
+// Ping pong through two queues with an echo thread
+template <QueueAdapter Adapter>
+Result runRoundTrip(const Options& options, std::string_view name)
+{
+  using T = typename Adapter::value_type;
+  Result result {
+      std::string(name), sizeof(T), "rtt", 1, 1, "ns RTT"};
+  result.capacity_ = options.capacity_;
+  std::array<double, PerfCounters::COUNTERS> misses {};
+  for (std::size_t trial {}; trial < options.warmup_ + options.trials_;
+       ++trial)
+  {
+    Adapter q1(options.capacity_, 1);
+    Adapter q2(options.capacity_, 1);
+    // Also counts the thread start up, small next to iters round trips
+    std::optional<PerfCounters> counters;
+    if (options.counters_)
+    {
+      counters.emplace();
+      counters->start();
+    }
+    auto thrd = std::thread([&]() {
+      pinThread(options.cpu(0));
+      T val;
+      for (std::size_t i {}; i < options.iters_; ++i)
+      {
+        while (! q1.try_pop(val)) {}
+        q2.push(val);
+      }
+    });
+
+    std::size_t roundTripTime {};
+    auto pinger = std::thread([&]() {
+      pinThread(options.cpu(1));
+      auto start = std::chrono::steady_clock::now();
+      for (std::size_t i {}; i < options.iters_; ++i)
+      {
+        T val(static_cast<int>(i));
+        q1.push(val);
+        while (! q2.try_pop(val)) {}
+      }
+      auto stop     = std::chrono::steady_clock::now();
+      roundTripTime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          stop - start)
+                          .count() /
+                      options.iters_;
+    });
+    pinger.join();
+    thrd.join();
+    if (trial < options.warmup_)
+    {
+      continue;
+    }
+    if (counters)
+    {
+      counters->stop();
+      addCounts(misses, counters->read());
+    }
+    result.trials_.push_back(roundTripTime);
+  }
+  std::sort(result.trials_.begin(), result.trials_.end());
+  if (options.counters_)
+  {
+    result.counters_ = perOperation(misses, options.iters_ * options.trials_);
+  }
+  return result;
+}
+
+// One producer timestamps each message, one consumer records the latency from
+// the timestamp to the pop. The payload carries the low 32 bits of the
+// timestamp, enough for latencies below a second.
+template <QueueAdapter Adapter>
+Result runLatency(const Options& options, std::string_view name)
+{
+  using T = typename Adapter::value_type;
+  Result result {std::string(name), sizeof(T), "latency", 1, 1, "ns"};
+  result.capacity_ = options.capacity_;
+  LatencyHistogram histogram;
+  auto const nsPerTick = TscClock::nanosecondsPerTick();
+  auto const intervalTicks =
+      static_cast<std::uint64_t>(options.latencyInterval_.count() / nsPerTick);
+
+  // The messages of the warmup runs are sent first and not recorded
+  auto const warmup   = options.warmup_ * options.latencyIters_;
+  auto const messages = warmup + options.latencyIters_;
+
+  Adapter queue(options.capacity_, 1);
+  auto thrd = std::thread([&]() {
+    pinThread(options.cpu(0));
+    T val;
+    for (std::size_t i {}; i < messages; ++i)
+    {
+      while (! queue.try_pop(val)) {}
+      auto const stop  = static_cast<std::uint32_t>(TscClock::now());
+      auto const ticks = stop - static_cast<std::uint32_t>(val.x_);
+      if (i >= warmup)
+      {
+        histogram.record(static_cast<std::uint64_t>(
+            static_cast<double>(ticks) * nsPerTick));
+      }
+    }
+  });
+
+  auto producer = std::thread([&]() {
+    pinThread(options.cpu(1));
+    for (std::size_t i {}; i < messages; ++i)
+    {
+      auto const start = TscClock::now();
+      T val(static_cast<int>(static_cast<std::uint32_t>(start)));
+      queue.push(val);
+      while (TscClock::now() - start < intervalTicks) {}
+    }
+  });
+  producer.join();
+  thrd.join();
+  result.latency_ = std::move(histogram);
+  result.memory_  = memoryFootprint(queue);
+  return result;
+}
+
+// Runs every selected scenario that the adapter supports
+template <QueueAdapter Adapter>
+void runScenarios(const Options& options, std::string_view name,
+                  ResultPrinter& printer)
+{
+  for (auto const& scenario : options.scenarios_)
+  {
+    if (scenario == "throughput" || scenario == "bulk" ||
+        scenario == "contention")
+    {
+      auto const transfer = scenario == "bulk"         ? Transfer::Bulk
+                            : scenario == "contention" ? Transfer::Try
+                                                       : Transfer::Blocking;
+      if ((transfer == Transfer::Bulk && ! BulkQueueAdapter<Adapter>) ||
+          (transfer == Transfer::Try && ! TryQueueAdapter<Adapter>))
+      {
+        continue;
+      }
+      for (auto const& config : options.threads_)
+      {
+        if (config.producers_ > maxProducers<Adapter>() ||
+            config.consumers_ > maxConsumers<Adapter>() ||
+            config.producers_ < 1 || config.consumers_ < 1)
+        {
+          continue;
+        }
+        printer.print(
+            runThroughput<Adapter>(options, name, scenario, config, transfer));
+      }
+    }
+    else if (scenario == "rtt")
+    {
+      printer.print(runRoundTrip<Adapter>(options, name));
+    }
+    else if (scenario == "latency")
+    {
+      printer.print(runLatency<Adapter>(options, name));
+    }
+    else
+    {
+      throw std::invalid_argument("Unknown scenario " + scenario);
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,218 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// Fan out of one producer to N consumers that each read every element.
+// dro::BroadcastQueue, gated and lossy, writes each element once, the
+// baseline pushes a copy to N independent SingleProducer / SingleConsumer
+// dro::MPMC_Queue instances.
+//
+// Uses the --threads (1 x consumers), --sizes, --iters, --trials, --capacity,
+// --cpus, --queues and --format harness options. The throughput counts the
+// elements published per ms, the lossy queue also reports the elements its
+// consumers skipped in its name.
+//
+// Example:
+//   broadcast-queue-benchmark --threads 1x2,1x6 --sizes 64 --capacity 4096
+
+#include "benchmark-harness.hpp"
+#include "dro/broadcast-queue.hpp"
+#include "dro/mpmc-queue.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+template <typename T, bool Lossy> class BroadcastAdapter
+{
+private:
+  dro::BroadcastQueue<T, Lossy> queue_;
+
+public:
+  using value_type            = T;
+  static constexpr bool lossy = Lossy;
+
+  BroadcastAdapter(std::size_t capacity, std::size_t consumers)
+      : queue_(capacity, consumers)
+  {
+  }
+
+  void push(const T& val) { queue_.push(val); }
+
+  bool try_pop(std::size_t consumer, T& val)
+  {
+    return queue_.try_pop(consumer, val);
+  }
+
+  [[nodiscard]] std::size_t lost(std::size_t consumer) const
+  {
+    if constexpr (Lossy)
+    {
+      return queue_.lost(consumer);
+    }
+    return 0;
+  }
+
+  [[nodiscard]] std::size_t memory() const noexcept
+  {
+    return sizeof(dro::details::broadcast_slot<T>) * queue_.capacity();
+  }
+};
+
+template <typename T> class FanOutAdapter
+{
+private:
+  using queue_type = dro::MPMC_Queue<T, std::allocator<dro::Slot<T>>,
+                                     dro::SingleProducer, dro::SingleConsumer>;
+
+  std::vector<std::unique_ptr<queue_type>> queues_;
+
+public:
+  using value_type            = T;
+  static constexpr bool lossy = false;
+
+  FanOutAdapter(std::size_t capacity, std::size_t consumers)
+  {
+    for (std::size_t i {}; i < consumers; ++i)
+    {
+      queues_.push_back(std::make_unique<queue_type>(capacity));
+    }
+  }
+
+  void push(const T& val)
+  {
+    for (auto& queue : queues_) { queue->push(val); }
+  }
+
+  bool try_pop(std::size_t consumer, T& val)
+  {
+    return queues_[consumer]->try_pop(val);
+  }
+
+  [[nodiscard]] std::size_t lost(std::size_t) const { return 0; }
+
+  [[nodiscard]] std::size_t memory() const noexcept
+  {
+    return sizeof(typename queue_type::slot_type) *
+           (queues_.front()->capacity() + 1) * queues_.size();
+  }
+};
+
+template <typename Adapter>
+Result runFanOut(const Options& options, std::string_view name,
+                 std::size_t consumers)
+{
+  using T = typename Adapter::value_type;
+  Result result {std::string(name), sizeof(T), "broadcast", 1, consumers,
+                 "ops/ms"};
+  result.capacity_ = options.capacity_;
+  std::size_t lost {};
+  for (std::size_t trial {}; trial < options.trials_; ++trial)
+  {
+    Adapter queue(options.capacity_, consumers);
+    result.memory_ = queue.memory();
+    std::atomic<std::size_t> skipped {0};
+    std::atomic<bool> flag(false);
+    std::vector<std::thread> threads;
+    for (std::size_t i {}; i < consumers; ++i)
+    {
+      threads.emplace_back([&, i, cpu = options.cpu(threads.size())]() {
+        pinThread(cpu);
+        while (! flag) {}
+        T val;
+        std::size_t read {};
+        while (read + queue.lost(i) < options.iters_)
+        {
+          read += queue.try_pop(i, val) ? 1 : 0;
+        }
+        skipped.fetch_add(queue.lost(i), std::memory_order_relaxed);
+      });
+    }
+    threads.emplace_back([&, cpu = options.cpu(threads.size())]() {
+      pinThread(cpu);
+      while (! flag) {}
+      for (std::size_t i {}; i < options.iters_; ++i)
+      {
+        T val(static_cast<int>(i));
+        queue.push(val);
+      }
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    flag       = true;
+    for (auto& thrd : threads) { thrd.join(); }
+    auto stop = std::chrono::steady_clock::now();
+    lost += skipped;
+
+    result.trials_.push_back(
+        options.iters_ * 1'000'000 /
+        std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start)
+            .count());
+  }
+  std::sort(result.trials_.begin(), result.trials_.end());
+  if constexpr (Adapter::lossy)
+  {
+    result.queue_ += " lost " + std::to_string(lost / options.trials_);
+  }
+  return result;
+}
+
+template <typename T>
+void runPayload(const Options& options, ResultPrinter& printer)
+{
+  for (auto const& config : options.threads_)
+  {
+    if (config.producers_ != 1 || config.consumers_ < 1)
+    {
+      continue;
+    }
+    if (options.selected("dro::BroadcastQueue"))
+    {
+      printer.print(runFanOut<BroadcastAdapter<T, false>>(
+          options, "dro::BroadcastQueue", config.consumers_));
+    }
+    if (options.selected("dro::BroadcastQueue<Lossy>"))
+    {
+      printer.print(runFanOut<BroadcastAdapter<T, true>>(
+          options, "dro::BroadcastQueue<Lossy>", config.consumers_));
+    }
+    if (options.selected("dro::MPMC_Queue"))
+    {
+      printer.print(runFanOut<FanOutAdapter<T>>(
+          options, "dro::MPMC_Queue x consumers", config.consumers_));
+    }
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  try
+  {
+    auto options = parseOptions(argc, argv);
+    if (options.threads_ == Options {}.threads_)
+    {
+      options.threads_ = {{1, 2}, {1, 6}};
+    }
+    ResultPrinter printer(options.format_);
+    for (auto const size : options.sizes_)
+    {
+      dispatchPayload(size, [&]<typename T>() {
+        runPayload<T>(options, printer);
+      });
+    }
+    printer.finish();
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << "\n";
+    printUsage(argv[0]);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,158 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// Task throughput of dro::MPMC_Queue<dro::InplaceFunction> against
+// dro::MPMC_Queue<std::function>. Every task captures enough bytes to fill an
+// InplaceFunction sized to a --sizes byte slot, std::function allocates each
+// capture on the heap instead.
+//
+// Producers construct and push --iters tasks each, consumers pop and invoke
+// them. Uses the --threads, --sizes (64 and 128 by default), --iters,
+// --trials, --capacity, --cpus, --queues and --format harness options.
+//
+// Example:
+//   inplace-function-benchmark --threads 1x1,2x2 --capacity 4096
+
+#include "benchmark-harness.hpp"
+#include "dro/inplace-function.hpp"
+#include "dro/mpmc-queue.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// The capture fills the InplaceFunction storage
+template <std::size_t SlotSize>
+using Capture = std::array<std::byte, dro::inplaceCapacity<SlotSize>>;
+
+template <typename Task, std::size_t SlotSize>
+Result runTasks(const Options& options, std::string_view name,
+                ThreadConfig config)
+{
+  Result result {std::string(name), SlotSize,          "throughput",
+                 config.producers_, config.consumers_, "ops/ms"};
+  result.capacity_       = options.capacity_;
+  auto const threadCount = std::max(config.producers_, config.consumers_);
+  auto const total       = options.iters_ * config.producers_;
+  for (std::size_t trial {}; trial < options.trials_; ++trial)
+  {
+    dro::MPMC_Queue<Task> queue(options.capacity_);
+    result.memory_ = sizeof(dro::Slot<Task>) * (queue.capacity() + 1);
+    std::atomic<std::uint64_t> sink {0};
+    std::atomic<bool> flag(false);
+    std::vector<std::thread> threads;
+    for (std::size_t i {}; i < threadCount; ++i)
+    {
+      if (i < config.consumers_)
+      {
+        auto const count = total / config.consumers_ +
+                           (i < total % config.consumers_ ? 1 : 0);
+        threads.emplace_back(
+            [&, count, cpu = options.cpu(threads.size())]() {
+              pinThread(cpu);
+              while (! flag) {}
+              std::uint64_t sum {};
+              Task task;
+              for (std::size_t j {}; j < count; ++j)
+              {
+                queue.pop(task);
+                task(sum);
+              }
+              sink.fetch_add(sum, std::memory_order_relaxed);
+            });
+      }
+      if (i < config.producers_)
+      {
+        threads.emplace_back([&, cpu = options.cpu(threads.size())]() {
+          pinThread(cpu);
+          while (! flag) {}
+          Capture<SlotSize> capture {};
+          for (std::size_t j {}; j < options.iters_; ++j)
+          {
+            capture[0] = static_cast<std::byte>(j);
+            queue.push(Task([capture](std::uint64_t& sum) {
+              sum += static_cast<std::uint64_t>(capture[0]);
+            }));
+          }
+        });
+      }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    flag       = true;
+    for (auto& thrd : threads) { thrd.join(); }
+    auto stop = std::chrono::steady_clock::now();
+
+    result.trials_.push_back(
+        total * 1'000'000 /
+        std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start)
+            .count());
+  }
+  std::sort(result.trials_.begin(), result.trials_.end());
+  return result;
+}
+
+template <std::size_t SlotSize>
+void runSize(const Options& options, ResultPrinter& printer)
+{
+  using Inplace = dro::InplaceFunction<void(std::uint64_t&),
+                                       dro::inplaceCapacity<SlotSize>>;
+  using Standard = std::function<void(std::uint64_t&)>;
+  for (auto const& config : options.threads_)
+  {
+    if (config.producers_ < 1 || config.consumers_ < 1)
+    {
+      continue;
+    }
+    if (options.selected("dro::InplaceFunction"))
+    {
+      printer.print(runTasks<Inplace, SlotSize>(
+          options, "dro::InplaceFunction", config));
+    }
+    if (options.selected("std::function"))
+    {
+      printer.print(
+          runTasks<Standard, SlotSize>(options, "std::function", config));
+    }
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  try
+  {
+    auto options = parseOptions(argc, argv);
+    if (options.sizes_ == Options {}.sizes_)
+    {
+      options.sizes_ = {64, 128};
+    }
+    ResultPrinter printer(options.format_);
+    for (auto const size : options.sizes_)
+    {
+      switch (size)
+      {
+      case 64: runSize<64>(options, printer); break;
+      case 128: runSize<128>(options, printer); break;
+      default: throw std::invalid_argument("Sizes must be 64 or 128");
+      }
+    }
+    printer.finish();
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << "\n";
+    printUsage(argv[0]);
+    return 1;
+  }
+  return 0;
+}
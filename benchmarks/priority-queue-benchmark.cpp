@@ -0,0 +1,154 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// Control lane latency while a bulk producer keeps the queue saturated. One
+// producer timestamps paced control messages, a second pushes bulk messages as
+// fast as the queue accepts them and one consumer records the latency of the
+// control messages only. A single shared dro::MPMC_Queue is the baseline, its
+// control messages wait behind the whole bulk backlog.
+//
+// Uses the --capacity (per lane), --latency-iters, --interval, --cpus,
+// --queues and --format options of the benchmark harness.
+//
+// Example:
+//   priority-queue-benchmark --capacity 4096 --latency-iters 100000
+
+#include "benchmark-harness.hpp"
+#include "dro/mpmc-queue.hpp"
+#include "dro/priority-queue.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+
+struct Message
+{
+  std::uint64_t stamp_ {};
+  std::uint32_t lane_ {};
+};
+
+static constexpr std::size_t controlLane = 0;
+static constexpr std::size_t bulkLane    = 1;
+
+class PriorityLanes
+{
+private:
+  dro::MPMC_PriorityQueue<Message, 2> queue_;
+
+public:
+  explicit PriorityLanes(std::size_t capacity) : queue_(capacity) {}
+
+  void push(std::size_t lane, const Message& val) { queue_.push(lane, val); }
+
+  bool try_push(std::size_t lane, const Message& val)
+  {
+    return queue_.try_push(lane, val);
+  }
+
+  bool try_pop(Message& val) { return queue_.try_pop(val); }
+};
+
+// Every lane shares one FIFO queue with the capacity of both lanes
+class SharedQueue
+{
+private:
+  dro::MPMC_Queue<Message> queue_;
+
+public:
+  explicit SharedQueue(std::size_t capacity) : queue_(2 * capacity) {}
+
+  void push(std::size_t, const Message& val) { queue_.push(val); }
+
+  bool try_push(std::size_t, const Message& val)
+  {
+    return queue_.try_push(val);
+  }
+
+  bool try_pop(Message& val) { return queue_.try_pop(val); }
+};
+
+template <typename Queue>
+Result runControlLatency(const Options& options, std::string_view name)
+{
+  Result result {std::string(name), sizeof(Message), "control-latency", 2, 1,
+                 "ns"};
+  result.capacity_ = options.capacity_;
+  LatencyHistogram histogram;
+  auto const nsPerTick = TscClock::nanosecondsPerTick();
+  auto const intervalTicks =
+      static_cast<std::uint64_t>(options.latencyInterval_.count() / nsPerTick);
+
+  Queue queue(options.capacity_);
+  std::atomic<bool> stop {false};
+  auto consumer = std::thread([&]() {
+    pinThread(options.cpu(0));
+    Message val;
+    for (std::size_t received {}; received < options.latencyIters_;)
+    {
+      if (! queue.try_pop(val) || val.lane_ != controlLane)
+      {
+        continue;
+      }
+      auto const ticks = TscClock::now() - val.stamp_;
+      histogram.record(
+          static_cast<std::uint64_t>(static_cast<double>(ticks) * nsPerTick));
+      ++received;
+    }
+    stop.store(true, std::memory_order_relaxed);
+  });
+
+  auto bulk = std::thread([&]() {
+    pinThread(options.cpu(1));
+    Message const val {0, bulkLane};
+    while (! stop.load(std::memory_order_relaxed))
+    {
+      [[maybe_unused]] auto const pushed = queue.try_push(bulkLane, val);
+    }
+  });
+
+  auto control = std::thread([&]() {
+    pinThread(options.cpu(2));
+    for (std::size_t i {}; i < options.latencyIters_; ++i)
+    {
+      auto const start = TscClock::now();
+      queue.push(controlLane, Message {start, controlLane});
+      while (TscClock::now() - start < intervalTicks) {}
+    }
+  });
+  control.join();
+  consumer.join();
+  bulk.join();
+  result.latency_ = std::move(histogram);
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  try
+  {
+    auto const options = parseOptions(argc, argv);
+    ResultPrinter printer(options.format_);
+    if (options.selected("dro::MPMC_PriorityQueue"))
+    {
+      printer.print(runControlLatency<PriorityLanes>(
+          options, "dro::MPMC_PriorityQueue"));
+    }
+    if (options.selected("dro::MPMC_Queue"))
+    {
+      printer.print(
+          runControlLatency<SharedQueue>(options, "dro::MPMC_Queue"));
+    }
+    printer.finish();
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << "\n";
+    printUsage(argv[0]);
+    return 1;
+  }
+  return 0;
+}
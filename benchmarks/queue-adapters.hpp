@@ -0,0 +1,308 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// Queue adapters for the benchmark harness. An adapter is constructed from
+// (capacity, thread count) and exposes push() and try_pop(), optionally
+// try_push(), push_bulk() / try_pop_bulk(), memory() and max_producers /
+// max_consumers.
+
+#ifndef DRO_BENCHMARK_QUEUE_ADAPTERS
+#define DRO_BENCHMARK_QUEUE_ADAPTERS
+
+#include "benchmark-harness.hpp"
+#include "dro/async-queue.hpp"
+#include "dro/event-queue.hpp"
+#include "dro/huge-page-allocator.hpp"
+#include "dro/mpmc-queue.hpp"
+#include "dro/segmented-queue.hpp"
+#include "dro/sharded-queue.hpp"
+#include "dro/shm-queue.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <string_view>
+
+#if __has_include(<rigtorp/MPMCQueue.h> )
+#include <rigtorp/MPMCQueue.h>
+#endif
+
+#if __has_include(<boost/lockfree/queue.hpp> )
+#include <boost/lockfree/queue.hpp>
+#endif
+
+#if __has_include(<concurrentqueue/moodycamel/concurrentqueue.h>)
+#include <concurrentqueue/moodycamel/concurrentqueue.h>
+#endif
+
+template <typename Queue> class DroAdapter
+{
+private:
+  Queue queue_;
+
+public:
+  using value_type = typename Queue::value_type;
+
+  static constexpr std::size_t max_producers =
+      Queue::single_producer ? 1 : std::numeric_limits<std::size_t>::max();
+  static constexpr std::size_t max_consumers =
+      Queue::single_consumer ? 1 : std::numeric_limits<std::size_t>::max();
+
+  DroAdapter(std::size_t capacity, std::size_t) : queue_(capacity) {}
+
+  void push(const value_type& val) { queue_.emplace(val); }
+
+  bool try_push(const value_type& val) { return queue_.try_push(val); }
+
+  bool try_pop(value_type& val) { return queue_.try_pop(val); }
+
+  template <typename It> void push_bulk(It first, It last)
+  {
+    queue_.push_bulk(first, last);
+  }
+
+  template <typename It> std::size_t try_pop_bulk(It out, std::size_t count)
+  {
+    return queue_.try_pop_bulk(out, count);
+  }
+
+  [[nodiscard]] std::size_t memory() const noexcept
+  {
+    return sizeof(typename Queue::slot_type) * (queue_.capacity() + 1);
+  }
+};
+
+// One shard per thread on the busier side, the capacity is split between them
+template <typename T> class DroShardedAdapter
+{
+private:
+  dro::MPMC_ShardedQueue<T> queue_;
+
+public:
+  using value_type = T;
+
+  DroShardedAdapter(std::size_t capacity, std::size_t threads)
+      : queue_(threads, std::max<std::size_t>(capacity / threads, 1))
+  {
+  }
+
+  void push(const T& val) { queue_.emplace(val); }
+
+  bool try_push(const T& val) { return queue_.try_push(val); }
+
+  bool try_pop(T& val) { return queue_.try_pop(val); }
+
+  [[nodiscard]] std::size_t memory() const noexcept
+  {
+    return sizeof(dro::Slot<T>) * (queue_.capacity() + queue_.shard_count());
+  }
+};
+
+// The capacity is the segment capacity
+template <typename T> class DroSegmentedAdapter
+{
+private:
+  dro::MPMC_SegmentedQueue<T> queue_;
+
+public:
+  using value_type = T;
+
+  DroSegmentedAdapter(std::size_t capacity, std::size_t) : queue_(capacity) {}
+
+  void push(const T& val) { queue_.push(val); }
+
+  bool try_pop(T& val) { return queue_.try_pop(val); }
+
+  [[nodiscard]] std::size_t memory() const noexcept
+  {
+    return sizeof(dro::Slot<T>) * queue_.segment_capacity() *
+           queue_.segment_count();
+  }
+};
+
+// Anonymous memfd mapping, the same code path as a queue shared between
+// processes
+template <typename T> class DroShmAdapter
+{
+private:
+  dro::MPMC_ShmQueue<T> queue_;
+
+public:
+  using value_type = T;
+
+  DroShmAdapter(std::size_t capacity, std::size_t) : queue_(capacity) {}
+
+  void push(const T& val) { queue_.push(val); }
+
+  bool try_push(const T& val) { return queue_.try_push(val); }
+
+  bool try_pop(T& val) { return queue_.try_pop(val); }
+
+  [[nodiscard]] std::size_t memory() const noexcept
+  {
+    return sizeof(dro::Slot<T>) * queue_.capacity();
+  }
+};
+
+// Consumers spin in try_pop() and never arm, every push pays the notify()
+// check of an awake consumer on top of dro::MPMC_Queue
+template <typename T> class DroEventAdapter
+{
+private:
+  dro::MPMC_EventQueue<T> queue_;
+
+public:
+  using value_type = T;
+
+  DroEventAdapter(std::size_t capacity, std::size_t) : queue_(capacity) {}
+
+  void push(const T& val) { queue_.emplace(val); }
+
+  bool try_push(const T& val) { return queue_.try_push(val); }
+
+  bool try_pop(T& val) { return queue_.try_pop(val); }
+
+  [[nodiscard]] std::size_t memory() const noexcept
+  {
+    return sizeof(dro::Slot<T>) * (queue_.capacity() + 1);
+  }
+};
+
+// Threads use the synchronous operations and never suspend, every operation
+// pays the waiter list check on top of dro::MPMC_Queue
+template <typename T> class DroAsyncAdapter
+{
+private:
+  dro::MPMC_AsyncQueue<T> queue_;
+
+public:
+  using value_type = T;
+
+  DroAsyncAdapter(std::size_t capacity, std::size_t) : queue_(capacity) {}
+
+  void push(const T& val) { queue_.emplace(val); }
+
+  bool try_push(const T& val) { return queue_.try_push(val); }
+
+  bool try_pop(T& val) { return queue_.try_pop(val); }
+
+  [[nodiscard]] std::size_t memory() const noexcept
+  {
+    return sizeof(dro::Slot<T>) * (queue_.capacity() + 1);
+  }
+};
+
+#if __has_include(<rigtorp/MPMCQueue.h> )
+template <typename T> class RigtorpAdapter
+{
+private:
+  rigtorp::MPMCQueue<T> queue_;
+
+public:
+  using value_type = T;
+
+  RigtorpAdapter(std::size_t capacity, std::size_t) : queue_(capacity) {}
+
+  void push(const T& val) { queue_.emplace(val); }
+
+  bool try_push(const T& val) { return queue_.try_push(val); }
+
+  bool try_pop(T& val) { return queue_.try_pop(val); }
+};
+#endif
+
+#if __has_include(<boost/lockfree/queue.hpp> )
+template <typename T> class BoostAdapter
+{
+private:
+  boost::lockfree::queue<T> queue_;
+
+public:
+  using value_type = T;
+
+  BoostAdapter(std::size_t capacity, std::size_t) : queue_(capacity) {}
+
+  void push(const T& val)
+  {
+    while (! queue_.push(val)) {}
+  }
+
+  bool try_push(const T& val) { return queue_.push(val); }
+
+  bool try_pop(T& val) { return queue_.pop(val); }
+};
+#endif
+
+#if __has_include(<concurrentqueue/moodycamel/concurrentqueue.h>)
+template <typename T> class MoodycamelAdapter
+{
+private:
+  moodycamel::ConcurrentQueue<T> queue_;
+
+public:
+  using value_type = T;
+
+  MoodycamelAdapter(std::size_t capacity, std::size_t) : queue_(capacity) {}
+
+  void push(const T& val)
+  {
+    while (! queue_.enqueue(val)) {}
+  }
+
+  bool try_push(const T& val) { return queue_.enqueue(val); }
+
+  bool try_pop(T& val) { return queue_.try_dequeue(val); }
+};
+#endif
+
+// Calls visit.template operator()<Adapter>(name) for every benchmarked queue
+template <typename T, typename Visitor> void forEachQueue(Visitor&& visit)
+{
+  using SlotAllocator = std::allocator<dro::Slot<T>>;
+  visit.template operator()<DroAdapter<dro::MPMC_Queue<T>>>("dro::MPMC_Queue");
+  visit.template operator()<DroAdapter<
+      dro::MPMC_Queue<T, SlotAllocator, dro::PowerOfTwoCapacity>>>(
+      "dro::MPMC_Queue<PowerOfTwoCapacity>");
+  visit.template operator()<
+      DroAdapter<dro::MPMC_Queue<T, SlotAllocator, dro::PackedSlots>>>(
+      "dro::MPMC_Queue<PackedSlots>");
+  visit.template operator()<
+      DroAdapter<dro::MPMC_Queue<T, SlotAllocator, dro::TurnAlignedSlots>>>(
+      "dro::MPMC_Queue<TurnAlignedSlots>");
+  visit.template operator()<
+      DroAdapter<dro::MPMC_Queue<T, SlotAllocator, dro::TicketPrefetch<>>>>(
+      "dro::MPMC_Queue<TicketPrefetch>");
+  visit.template operator()<
+      DroAdapter<dro::MPMC_Queue<T, dro::HugePageAllocator<dro::Slot<T>>>>>(
+      "dro::MPMC_Queue<HugePageAllocator>");
+  visit.template operator()<DroAdapter<dro::MPMC_Queue<
+      T, SlotAllocator, dro::SingleProducer, dro::SingleConsumer>>>(
+      "dro::MPMC_Queue<SingleProducer, SingleConsumer>");
+  visit.template operator()<
+      DroAdapter<dro::MPMC_Queue<T, SlotAllocator, dro::SingleProducer,
+                                 dro::SingleConsumer, dro::TicketPrefetch<>>>>(
+      "dro::MPMC_Queue<SingleProducer, SingleConsumer, TicketPrefetch>");
+  visit.template operator()<
+      DroAdapter<dro::MPMC_Queue<T, SlotAllocator, dro::SingleProducer>>>(
+      "dro::MPMC_Queue<SingleProducer>");
+  visit.template operator()<
+      DroAdapter<dro::MPMC_Queue<T, SlotAllocator, dro::SingleConsumer>>>(
+      "dro::MPMC_Queue<SingleConsumer>");
+  visit.template operator()<DroEventAdapter<T>>("dro::MPMC_EventQueue");
+  visit.template operator()<DroAsyncAdapter<T>>("dro::MPMC_AsyncQueue");
+  visit.template operator()<DroShardedAdapter<T>>("dro::MPMC_ShardedQueue");
+  visit.template operator()<DroSegmentedAdapter<T>>(
+      "dro::MPMC_SegmentedQueue");
+  visit.template operator()<DroShmAdapter<T>>("dro::MPMC_ShmQueue");
+#if __has_include(<rigtorp/MPMCQueue.h> )
+  visit.template operator()<RigtorpAdapter<T>>("rigtorp::MPMCQueue");
+#endif
+#if __has_include(<boost/lockfree/queue.hpp> )
+  visit.template operator()<BoostAdapter<T>>("boost::lockfree::queue");
+#endif
+#if __has_include(<concurrentqueue/moodycamel/concurrentqueue.h>)
+  visit.template operator()<MoodycamelAdapter<T>>(
+      "moodycamel::ConcurrentQueue");
+#endif
+}
+
+#endif
@@ -0,0 +1,215 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// Task throughput of dro::ThreadPool against a pool whose workers all pop
+// std::function tasks from one shared dro::MPMC_Queue.
+//
+// Scenarios:
+//   submit  P external threads submit --iters tasks each to C workers
+//   spawn   one root task spawns a binary tree of about --iters tasks from
+//           inside the workers
+//
+// Uses the --scenarios, --threads (submitters x workers), --iters, --trials,
+// --capacity, --cpus (workers), --queues and --format harness options.
+//
+// Example:
+//   thread-pool-benchmark --threads 1x2,2x4 --capacity 4096 --iters 1000000
+
+#include "benchmark-harness.hpp"
+#include "dro/mpmc-queue.hpp"
+#include "dro/thread-pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Every worker contends on the same queue, an empty function stops a worker.
+// Like dro::ThreadPool a worker runs a task inline when the queue is full,
+// otherwise a spawning workload could block every worker in push().
+class SharedQueuePool
+{
+private:
+  dro::MPMC_Queue<std::function<void()>> queue_;
+  std::vector<std::thread> threads_;
+
+  inline static thread_local bool worker_ {false};
+
+public:
+  using task_type = std::function<void()>;
+
+  SharedQueuePool(std::size_t threads, std::size_t capacity,
+                  const std::vector<int>& cpus)
+      : queue_(capacity)
+  {
+    for (std::size_t i {}; i < threads; ++i)
+    {
+      threads_.emplace_back([this] {
+        worker_ = true;
+        std::function<void()> task;
+        while (true)
+        {
+          queue_.pop(task);
+          if (! task)
+          {
+            return;
+          }
+          task();
+        }
+      });
+      if (! cpus.empty())
+      {
+        pinThread(threads_.back(), cpus[i % cpus.size()]);
+      }
+    }
+  }
+
+  ~SharedQueuePool()
+  {
+    for (std::size_t i {}; i < threads_.size(); ++i) { queue_.push(nullptr); }
+    for (auto& thread : threads_) { thread.join(); }
+  }
+
+  template <typename F> void submit(F&& f)
+  {
+    std::function<void()> task(std::forward<F>(f));
+    if (! worker_)
+    {
+      queue_.push(std::move(task));
+    }
+    else if (! queue_.try_push(std::move(task)))
+    {
+      task();
+    }
+  }
+};
+
+using DroPool = dro::ThreadPool<>;
+
+template <typename Pool>
+void spawn(Pool& pool, std::atomic<std::size_t>& count, int depth)
+{
+  count.fetch_add(1, std::memory_order_relaxed);
+  if (depth == 0)
+  {
+    return;
+  }
+  for (int i {}; i < 2; ++i)
+  {
+    pool.submit([&pool, &count, depth] { spawn(pool, count, depth - 1); });
+  }
+}
+
+template <typename Pool>
+Result runPool(const Options& options, std::string_view name,
+               std::string_view scenario, ThreadConfig config)
+{
+  auto const spawning = scenario == "spawn";
+  // A binary tree of depth d holds 2^(d + 1) - 1 tasks
+  auto const depth = static_cast<int>(
+      std::bit_width(std::max<std::size_t>(options.iters_, 2)) - 2);
+  auto const total = spawning ? (std::size_t {2} << depth) - 1
+                              : options.iters_ * config.producers_;
+  Result result {std::string(name),
+                 sizeof(typename Pool::task_type),
+                 std::string(scenario),
+                 spawning ? 1 : config.producers_,
+                 config.consumers_,
+                 "tasks/ms"};
+  result.capacity_ = options.capacity_;
+  for (std::size_t trial {}; trial < options.trials_; ++trial)
+  {
+    std::atomic<std::size_t> count {0};
+    Pool pool(config.consumers_, options.capacity_, options.cpus_);
+    auto const start = std::chrono::steady_clock::now();
+    if (spawning)
+    {
+      pool.submit([&pool, &count, depth] { spawn(pool, count, depth); });
+    }
+    else
+    {
+      std::vector<std::thread> submitters;
+      for (std::size_t i {}; i < config.producers_; ++i)
+      {
+        submitters.emplace_back([&] {
+          for (std::size_t j {}; j < options.iters_; ++j)
+          {
+            pool.submit(
+                [&count] { count.fetch_add(1, std::memory_order_relaxed); });
+          }
+        });
+      }
+      for (auto& thread : submitters) { thread.join(); }
+    }
+    while (count.load(std::memory_order_relaxed) < total)
+    {
+      std::this_thread::yield();
+    }
+    auto const stop = std::chrono::steady_clock::now();
+    result.trials_.push_back(
+        total * 1'000'000 /
+        std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start)
+            .count());
+  }
+  std::sort(result.trials_.begin(), result.trials_.end());
+  return result;
+}
+
+template <typename Pool>
+void runPoolScenarios(const Options& options, std::string_view name,
+                      ResultPrinter& printer)
+{
+  for (auto const& scenario : options.scenarios_)
+  {
+    if (scenario != "submit" && scenario != "spawn")
+    {
+      throw std::invalid_argument("Unknown scenario " + scenario);
+    }
+    for (auto const& config : options.threads_)
+    {
+      if (config.producers_ < 1 || config.consumers_ < 1)
+      {
+        continue;
+      }
+      printer.print(runPool<Pool>(options, name, scenario, config));
+    }
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  try
+  {
+    auto options = parseOptions(argc, argv);
+    if (options.scenarios_ == Options {}.scenarios_)
+    {
+      options.scenarios_ = {"submit", "spawn"};
+    }
+    ResultPrinter printer(options.format_);
+    if (options.selected("dro::ThreadPool"))
+    {
+      runPoolScenarios<DroPool>(options, "dro::ThreadPool", printer);
+    }
+    if (options.selected("SharedQueuePool"))
+    {
+      runPoolScenarios<SharedQueuePool>(options, "SharedQueuePool", printer);
+    }
+    printer.finish();
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << e.what() << "\n";
+    printUsage(argv[0]);
+    return 1;
+  }
+  return 0;
+}
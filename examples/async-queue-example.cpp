@@ -0,0 +1,37 @@
+
+#include <coroutine>
+#include <dro/async-queue.hpp>
+#include <exception>
+#include <iostream>
+
+struct Task {
+  struct promise_type {
+    Task get_return_object() noexcept { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() noexcept {}
+    void unhandled_exception() noexcept { std::terminate(); }
+  };
+};
+
+Task consumer(dro::MPMC_AsyncQueue<int> &q) {
+  for (int i = 0; i < 4; ++i) {
+    std::cout << co_await q.async_pop() << '\n';
+  }
+}
+
+Task producer(dro::MPMC_AsyncQueue<int> &q) {
+  for (int i = 0; i < 4; ++i) {
+    co_await q.async_push(i);
+  }
+}
+
+int main(int argc, char *argv[]) {
+
+  dro::MPMC_AsyncQueue<int> q {2};
+  // Suspends on the empty queue, resumed by each push
+  consumer(q);
+  producer(q);
+
+  return 0;
+}
@@ -0,0 +1,69 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// Asymmetric fences for a Dekker style handshake with a hot and a rare side.
+// The hot side stores, calls asymmetric_fence_light() and loads, the rare side
+// stores, calls asymmetric_fence_heavy() and loads. Either the hot side sees
+// the store of the rare side or the rare side sees the store of the hot side.
+//
+// The light fence is only a compiler barrier. The heavy fence is a private
+// expedited membarrier, which runs a full memory barrier on every cpu that
+// currently runs a thread of the process. Without membarrier, e.g. on kernels
+// before 4.14, both fences are a seq_cst fence.
+
+#ifndef DRO_ASYMMETRIC_FENCE
+#define DRO_ASYMMETRIC_FENCE
+
+#include <atomic>// for atomic_signal_fence, atomic_thread_fence
+
+#if __has_include(<linux/membarrier.h>)
+#include <linux/membarrier.h>// for MEMBARRIER_CMD_PRIVATE_EXPEDITED
+#include <sys/syscall.h>     // for SYS_membarrier
+#include <unistd.h>          // for syscall
+#endif
+
+namespace dro
+{
+
+namespace details
+{
+// Registers the process for private expedited membarriers on first use. Call
+// it once before the hot side runs so the registration is not on its path.
+[[nodiscard]] inline bool membarrier_available() noexcept
+{
+  static const bool available = [] {
+#if __has_include(<linux/membarrier.h>)
+    return ::syscall(SYS_membarrier,
+                     MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0;
+#else
+    return false;
+#endif
+  }();
+  return available;
+}
+
+inline void asymmetric_fence_light() noexcept
+{
+  if (membarrier_available())
+  {
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+  }
+  else
+  {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+}
+
+inline void asymmetric_fence_heavy() noexcept
+{
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+#if __has_include(<linux/membarrier.h>)
+  if (membarrier_available())
+  {
+    ::syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+#endif
+}
+}// namespace details
+}// namespace dro
+#endif
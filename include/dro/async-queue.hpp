@@ -0,0 +1,374 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// dro::MPMC_Queue with C++20 coroutine awaitables for async pipelines.
+//
+//   auto val = co_await queue.async_pop();
+//   co_await queue.async_push(val);
+//
+// 1) An awaitable first tries the queue and only suspends when it is empty,
+//    or full for async_push(). A suspended coroutine links a waiter node from
+//    its frame onto a lock free list of consumers or producers.
+// 2) Every successful operation, async or not, checks the opposite list with
+//    a compiler barrier and one load. When the list is not empty the thread
+//    takes the whole list, hands elements or slots to the waiters and resumes
+//    the served coroutines inline. Waiters that cannot be served are linked
+//    again.
+// 3) A waiter rechecks the queue after linking itself. The asymmetric fences
+//    make sure that either the waiter sees the change or the other side sees
+//    the waiter, so no wake up is lost. The membarrier of the heavy fence is
+//    only paid when a waiter is linked, see asymmetric-fence.hpp.
+// 4) The rechecks read the turn of the next slot with front_ready() and
+//    back_ready(). A ticket claimed by an operation that has not published
+//    its slot yet does not count, that operation serves the waiters itself.
+//
+// Lists are only ever taken whole, so the lists are safe from ABA without
+// tags. The queue must outlive every suspended coroutine.
+
+#ifndef DRO_ASYNC_QUEUE
+#define DRO_ASYNC_QUEUE
+
+#include "dro/asymmetric-fence.hpp"
+#include "dro/mpmc-queue.hpp"
+
+#include <atomic>   // for atomic, memory_order
+#include <coroutine>// for coroutine_handle
+#include <cstddef>  // for size_t, ptrdiff_t
+#include <memory>   // for allocator
+#include <utility>  // for forward, move
+
+namespace dro
+{
+
+namespace details
+{
+struct async_waiter
+{
+  std::coroutine_handle<> handle_;
+  async_waiter* next_ {};
+};
+
+// Treiber stack that is only ever taken whole
+class waiter_list
+{
+private:
+  std::atomic<async_waiter*> top_ {nullptr};
+
+public:
+  void link(async_waiter* waiter) noexcept
+  {
+    waiter->next_ = top_.load(std::memory_order_relaxed);
+    while (! top_.compare_exchange_weak(waiter->next_, waiter,
+                                        std::memory_order_release,
+                                        std::memory_order_relaxed))
+    {
+    }
+  }
+
+  // Oldest waiter first
+  [[nodiscard]] async_waiter* take() noexcept
+  {
+    auto* waiter         = top_.exchange(nullptr, std::memory_order_acquire);
+    async_waiter* oldest = nullptr;
+    while (waiter)
+    {
+      auto* next    = waiter->next_;
+      waiter->next_ = oldest;
+      oldest        = waiter;
+      waiter        = next;
+    }
+    return oldest;
+  }
+
+  [[nodiscard]] bool empty() const noexcept
+  {
+    return top_.load(std::memory_order_relaxed) == nullptr;
+  }
+};
+}// namespace details
+
+template <MPMC_Type T, typename Allocator = std::allocator<Slot<T>>,
+          MPMC_Policy... Policies>
+class MPMC_AsyncQueue
+{
+public:
+  using queue_type = MPMC_Queue<T, Allocator, Policies...>;
+  using value_type = T;
+
+private:
+  struct pop_waiter : details::async_waiter
+  {
+    T value_ {};
+  };
+
+  struct push_waiter : details::async_waiter
+  {
+    T value_;
+  };
+
+  queue_type queue_;
+  alignas(cacheLineSize) details::waiter_list consumers_;
+  alignas(cacheLineSize) details::waiter_list producers_;
+
+  // Serves the waiters of one list, the failed ones are linked again. Returns
+  // whether any waiter was served, served waiters other than self are added
+  // to ready.
+  template <typename Waiter, typename Serve, typename Available>
+  bool serve(details::waiter_list& list, details::async_waiter* self,
+             bool& selfServed, details::async_waiter*& ready, Serve&& serveOne,
+             Available&& available) noexcept
+  {
+    auto progress = false;
+    while (true)
+    {
+      auto* waiter = list.take();
+      if (! waiter)
+      {
+        return progress;
+      }
+      auto relinked = false;
+      while (waiter)
+      {
+        auto* next = waiter->next_;
+        if (serveOne(*static_cast<Waiter*>(waiter)))
+        {
+          progress = true;
+          if (waiter == self)
+          {
+            selfServed = true;
+          }
+          else
+          {
+            waiter->next_ = ready;
+            ready         = waiter;
+          }
+        }
+        else
+        {
+          list.link(waiter);
+          relinked = true;
+        }
+        waiter = next;
+      }
+      if (! relinked)
+      {
+        return progress;
+      }
+      // The other side may have missed the relinked waiters, pairs with the
+      // light fence in notify()
+      details::asymmetric_fence_heavy();
+      if (! available())
+      {
+        return progress;
+      }
+    }
+  }
+
+  // Serves both lists until neither makes progress, then resumes the served
+  // coroutines. Returns whether self was served instead of resumed.
+  bool drain(details::async_waiter* self = nullptr) noexcept
+  {
+    auto selfServed               = false;
+    details::async_waiter* ready = nullptr;
+    auto progress                 = true;
+    while (progress)
+    {
+      progress = serve<pop_waiter>(
+          consumers_, self, selfServed, ready,
+          [this](pop_waiter& w) { return queue_.try_pop(w.value_); },
+          [this] { return queue_.front_ready(); });
+      progress |= serve<push_waiter>(
+          producers_, self, selfServed, ready,
+          [this](push_waiter& w) {
+            return queue_.try_push(std::move(w.value_));
+          },
+          [this] { return queue_.back_ready(); });
+    }
+    while (ready)
+    {
+      auto* next = ready->next_;
+      ready->handle_.resume();
+      ready = next;
+    }
+    return selfServed;
+  }
+
+  void notify(const details::waiter_list& list) noexcept
+  {
+    // Orders the operation before the load, pairs with the heavy fences in
+    // suspend_pop(), suspend_push() and serve()
+    details::asymmetric_fence_light();
+    if (! list.empty())
+    {
+      drain();
+    }
+  }
+
+  // Return whether the coroutine stays suspended. Once linked the waiter can
+  // be resumed and destroyed by another thread, only the queue is read after.
+  bool suspend_pop(details::async_waiter& waiter) noexcept
+  {
+    consumers_.link(&waiter);
+    details::asymmetric_fence_heavy();
+    return ! queue_.front_ready() || ! drain(&waiter);
+  }
+
+  bool suspend_push(details::async_waiter& waiter) noexcept
+  {
+    producers_.link(&waiter);
+    details::asymmetric_fence_heavy();
+    return ! queue_.back_ready() || ! drain(&waiter);
+  }
+
+public:
+  class pop_awaitable
+  {
+  private:
+    MPMC_AsyncQueue& queue_;
+    pop_waiter waiter_;
+
+  public:
+    explicit pop_awaitable(MPMC_AsyncQueue& queue) noexcept : queue_(queue) {}
+
+    [[nodiscard]] bool await_ready() noexcept
+    {
+      return queue_.try_pop(waiter_.value_);
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle) noexcept
+    {
+      waiter_.handle_ = handle;
+      return queue_.suspend_pop(waiter_);
+    }
+
+    [[nodiscard]] T await_resume() noexcept(MPMC_NoThrow_Type<T>)
+    {
+      return std::move(waiter_.value_);
+    }
+  };
+
+  class push_awaitable
+  {
+  private:
+    MPMC_AsyncQueue& queue_;
+    push_waiter waiter_;
+
+  public:
+    template <typename... Args>
+    explicit push_awaitable(MPMC_AsyncQueue& queue, Args&&... args) noexcept(
+        MPMC_NoThrow_Type<T, Args&&...>)
+        : queue_(queue), waiter_ {{}, T(std::forward<Args>(args)...)}
+    {
+    }
+
+    [[nodiscard]] bool await_ready() noexcept
+    {
+      return queue_.try_push(std::move(waiter_.value_));
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle) noexcept
+    {
+      waiter_.handle_ = handle;
+      return queue_.suspend_push(waiter_);
+    }
+
+    void await_resume() noexcept {}
+  };
+
+  explicit MPMC_AsyncQueue(const std::size_t capacity,
+                           const Allocator& allocator = Allocator())
+      : queue_(capacity, allocator)
+  {
+    // Registers the membarrier off the push and pop paths
+    static_cast<void>(details::membarrier_available());
+  }
+
+  // non-copyable and non-movable
+  MPMC_AsyncQueue(const MPMC_AsyncQueue& lhs)        = delete;
+  MPMC_AsyncQueue(MPMC_AsyncQueue&& lhs)             = delete;
+  MPMC_AsyncQueue& operator=(const MPMC_AsyncQueue&) = delete;
+  MPMC_AsyncQueue& operator=(MPMC_AsyncQueue&&)      = delete;
+
+  // Suspends while the queue is empty
+  [[nodiscard]] pop_awaitable async_pop() noexcept
+  {
+    return pop_awaitable(*this);
+  }
+
+  // Suspends while the queue is full, the element is moved into the awaitable
+  template <typename... Args>
+    requires std::constructible_from<T, Args...>
+  [[nodiscard]] push_awaitable
+  async_push(Args&&... args) noexcept(MPMC_NoThrow_Type<T, Args&&...>)
+  {
+    return push_awaitable(*this, std::forward<Args>(args)...);
+  }
+
+  template <typename... Args>
+    requires std::constructible_from<T, Args...>
+  void emplace(Args&&... args) noexcept(MPMC_NoThrow_Type<T, Args&&...>)
+  {
+    queue_.emplace(std::forward<Args>(args)...);
+    notify(consumers_);
+  }
+
+  template <typename... Args>
+    requires std::constructible_from<T, Args...>
+  [[nodiscard]] bool
+  try_emplace(Args&&... args) noexcept(MPMC_NoThrow_Type<T, Args&&...>)
+  {
+    if (! queue_.try_emplace(std::forward<Args>(args)...))
+    {
+      return false;
+    }
+    notify(consumers_);
+    return true;
+  }
+
+  void push(const T& val) noexcept(MPMC_NoThrow_Type<T>) { emplace(val); }
+
+  template <typename P>
+    requires std::constructible_from<T, P&&>
+  void push(P&& val) noexcept(MPMC_NoThrow_Type<T, P&&>)
+  {
+    emplace(std::forward<P>(val));
+  }
+
+  [[nodiscard]] bool try_push(const T& val) noexcept(MPMC_NoThrow_Type<T>)
+  {
+    return try_emplace(val);
+  }
+
+  template <typename P>
+    requires std::constructible_from<T, P&&>
+  [[nodiscard]] bool try_push(P&& val) noexcept(MPMC_NoThrow_Type<T, P&&>)
+  {
+    return try_emplace(std::forward<P>(val));
+  }
+
+  void pop(T& val) noexcept(MPMC_NoThrow_Type<T>)
+  {
+    queue_.pop(val);
+    notify(producers_);
+  }
+
+  [[nodiscard]] bool try_pop(T& val) noexcept(MPMC_NoThrow_Type<T>)
+  {
+    if (! queue_.try_pop(val))
+    {
+      return false;
+    }
+    notify(producers_);
+    return true;
+  }
+
+  [[nodiscard]] std::ptrdiff_t size() const noexcept { return queue_.size(); }
+
+  [[nodiscard]] bool empty() const noexcept { return queue_.empty(); }
+
+  [[nodiscard]] std::size_t capacity() const noexcept
+  {
+    return queue_.capacity();
+  }
+};
+}// namespace dro
+#endif
@@ -0,0 +1,293 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// Single producer broadcast ring, every consumer sees every element. One
+// write serves all the consumers, each reads the slots through its own
+// cursor and nothing is copied per consumer on the producer side.
+//
+// 1) Like the turn of dro::Slot, each slot carries a sequence that the
+//    producer publishes after the write. A consumer at cursor c waits for the
+//    sequence of ticket c.
+// 2) Gated (default): the slowest consumer gates the wrap around. The
+//    producer caches the minimum cursor and only rescans the cursors when the
+//    cached value says the ring is full.
+// 3) Lossy: the producer never waits and overwrites the oldest slot. The
+//    sequence is a seqlock, odd while the slot is written, so a consumer
+//    detects a torn or overwritten read, skips to the oldest intact ticket and
+//    counts the gap in lost(). Lossy requires a trivially copyable T, the
+//    copy of a slot can race with its overwrite and the recheck of the
+//    sequence discards it.
+//
+// Consumers are numbered 0 to consumers - 1 and every consumer starts at the
+// first element. Each consumer index must be used by one thread at a time.
+
+#ifndef DRO_BROADCAST_QUEUE
+#define DRO_BROADCAST_QUEUE
+
+#include "dro/mpmc-queue.hpp"
+
+#include <algorithm>  // for min
+#include <atomic>     // for atomic, atomic_thread_fence, memory_order
+#include <concepts>   // for invocable
+#include <cstddef>    // for size_t
+#include <limits>     // for numeric_limits
+#include <memory>     // for unique_ptr, make_unique
+#include <stdexcept>  // for logic_error
+#include <type_traits>// for is_trivially_copyable_v, is_copy_assignable_v
+#include <utility>    // for forward
+
+namespace dro
+{
+
+namespace details
+{
+template <typename T> struct alignas(cacheLineSize) broadcast_slot
+{
+  T data_ {};
+  // Gated: ticket + 1 once written. Lossy: 2 * ticket + 1 while written and
+  // 2 * ticket + 2 once written.
+  std::atomic<std::size_t> sequence_ {0};
+};
+
+struct alignas(cacheLineSize) broadcast_cursor
+{
+  std::atomic<std::size_t> cursor_ {0};
+  std::atomic<std::size_t> lost_ {0};
+};
+}// namespace details
+
+template <MPMC_Type T, bool Lossy = false>
+  requires std::is_copy_assignable_v<T> &&
+           (! Lossy || std::is_trivially_copyable_v<T>)
+class BroadcastQueue
+{
+public:
+  using value_type            = T;
+  static constexpr bool lossy = Lossy;
+
+private:
+  using slot_type = details::broadcast_slot<T>;
+
+  std::size_t capacity_;
+  std::size_t consumers_;
+  std::unique_ptr<slot_type[]> slots_;
+  std::unique_ptr<details::broadcast_cursor[]> cursors_;
+  alignas(cacheLineSize) std::atomic<std::size_t> head_ {0};
+  // Producer only, the slowest cursor seen by the last scan
+  std::size_t gate_ {0};
+
+  [[nodiscard]] slot_type& slot_at(std::size_t ticket) noexcept
+  {
+    return slots_[ticket % capacity_];
+  }
+
+  [[nodiscard]] std::size_t min_cursor() const noexcept
+  {
+    auto cursor = std::numeric_limits<std::size_t>::max();
+    for (std::size_t i {}; i < consumers_; ++i)
+    {
+      cursor = std::min(
+          cursor, cursors_[i].cursor_.load(std::memory_order_acquire));
+    }
+    return cursor;
+  }
+
+  [[nodiscard]] bool has_room(std::size_t head) noexcept
+  {
+    if (head - gate_ < capacity_)
+    {
+      return true;
+    }
+    // Pairs with the release of the consumer cursor, the reads of the slot
+    // happen before it is overwritten
+    gate_ = min_cursor();
+    return head - gate_ < capacity_;
+  }
+
+  template <typename... Args> void write(std::size_t head, Args&&... args)
+  {
+    auto& slot = slot_at(head);
+    if constexpr (Lossy)
+    {
+      slot.sequence_.store(2 * head + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      slot.data_ = T(std::forward<Args>(args)...);
+      slot.sequence_.store(2 * head + 2, std::memory_order_release);
+    }
+    else
+    {
+      slot.data_ = T(std::forward<Args>(args)...);
+      slot.sequence_.store(head + 1, std::memory_order_release);
+    }
+    head_.store(head + 1, std::memory_order_release);
+  }
+
+public:
+  explicit BroadcastQueue(const std::size_t capacity,
+                          const std::size_t consumers)
+      : capacity_(capacity), consumers_(consumers)
+  {
+    if (capacity_ < 1)
+    {
+      throw std::logic_error("Capacity must be positive");
+    }
+    if (consumers_ < 1)
+    {
+      throw std::logic_error("Consumer count must be positive");
+    }
+    slots_   = std::make_unique<slot_type[]>(capacity_);
+    cursors_ = std::make_unique<details::broadcast_cursor[]>(consumers_);
+  }
+
+  // non-copyable and non-movable
+  BroadcastQueue(const BroadcastQueue& lhs)        = delete;
+  BroadcastQueue(BroadcastQueue&& lhs)             = delete;
+  BroadcastQueue& operator=(const BroadcastQueue&) = delete;
+  BroadcastQueue& operator=(BroadcastQueue&&)      = delete;
+
+  // Gated: spins while the slowest consumer is a full ring behind
+  template <typename... Args>
+  void emplace(Args&&... args) noexcept(MPMC_NoThrow_Type<T, Args...>)
+    requires std::is_constructible_v<T, Args&&...>
+  {
+    auto const head = head_.load(std::memory_order_relaxed);
+    if constexpr (! Lossy)
+    {
+      while (! has_room(head)) { details::cpu_relax(); }
+    }
+    write(head, std::forward<Args>(args)...);
+  }
+
+  // Lossy never fails
+  template <typename... Args>
+  [[nodiscard]] bool
+  try_emplace(Args&&... args) noexcept(MPMC_NoThrow_Type<T, Args...>)
+    requires std::is_constructible_v<T, Args&&...>
+  {
+    auto const head = head_.load(std::memory_order_relaxed);
+    if constexpr (! Lossy)
+    {
+      if (! has_room(head))
+      {
+        return false;
+      }
+    }
+    write(head, std::forward<Args>(args)...);
+    return true;
+  }
+
+  void push(const T& val) noexcept(MPMC_NoThrow_Type<T>) { emplace(val); }
+
+  [[nodiscard]] bool try_push(const T& val) noexcept(MPMC_NoThrow_Type<T>)
+  {
+    return try_emplace(val);
+  }
+
+  // Copies the next element of the consumer
+  [[nodiscard]] bool try_pop(const std::size_t consumer,
+                             T& val) noexcept(MPMC_NoThrow_Type<T>)
+  {
+    auto& cursor = cursors_[consumer];
+    auto ticket  = cursor.cursor_.load(std::memory_order_relaxed);
+    if constexpr (Lossy)
+    {
+      while (true)
+      {
+        auto& slot = slot_at(ticket);
+        auto seq   = slot.sequence_.load(std::memory_order_acquire);
+        if (seq < 2 * ticket + 2)
+        {
+          return false;
+        }
+        if (seq == 2 * ticket + 2)
+        {
+          val = slot.data_;
+          std::atomic_thread_fence(std::memory_order_acquire);
+          auto const recheck = slot.sequence_.load(std::memory_order_relaxed);
+          if (recheck == seq)
+          {
+            cursor.cursor_.store(ticket + 1, std::memory_order_relaxed);
+            return true;
+          }
+          seq = recheck;
+        }
+        // Overwritten, the sequence names the ticket that owns the slot now.
+        // It is at least a lap ahead and the capacity - 1 tickets before it
+        // are the oldest that can survive. The head is not ordered with the
+        // sequence, so it is not used here.
+        auto const owner = (seq - 1) / 2;
+        auto const next =
+            owner >= ticket + capacity_ ? owner + 1 - capacity_ : ticket + 1;
+        cursor.lost_.store(cursor.lost_.load(std::memory_order_relaxed) +
+                               (next - ticket),
+                           std::memory_order_relaxed);
+        ticket = next;
+        cursor.cursor_.store(ticket, std::memory_order_relaxed);
+      }
+    }
+    else
+    {
+      auto& slot = slot_at(ticket);
+      if (slot.sequence_.load(std::memory_order_acquire) != ticket + 1)
+      {
+        return false;
+      }
+      val = slot.data_;
+      cursor.cursor_.store(ticket + 1, std::memory_order_release);
+      return true;
+    }
+  }
+
+  void pop(const std::size_t consumer, T& val) noexcept(MPMC_NoThrow_Type<T>)
+  {
+    while (! try_pop(consumer, val)) { details::cpu_relax(); }
+  }
+
+  // Calls func with the next element of the consumer in place, the producer
+  // cannot overwrite it until func returns
+  template <typename Func>
+    requires std::invocable<Func&, const T&> && (! Lossy)
+  [[nodiscard]] bool try_read(const std::size_t consumer, Func&& func) noexcept(
+      std::is_nothrow_invocable_v<Func&, const T&>)
+  {
+    auto& cursor      = cursors_[consumer];
+    auto const ticket = cursor.cursor_.load(std::memory_order_relaxed);
+    auto& slot        = slot_at(ticket);
+    if (slot.sequence_.load(std::memory_order_acquire) != ticket + 1)
+    {
+      return false;
+    }
+    func(static_cast<const T&>(slot.data_));
+    cursor.cursor_.store(ticket + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Elements the consumer skipped because they were overwritten
+  [[nodiscard]] std::size_t lost(const std::size_t consumer) const noexcept
+    requires Lossy
+  {
+    return cursors_[consumer].lost_.load(std::memory_order_relaxed);
+  }
+
+  // Elements the consumer has not read yet, at most the capacity
+  [[nodiscard]] std::size_t size(const std::size_t consumer) const noexcept
+  {
+    auto const cursor =
+        cursors_[consumer].cursor_.load(std::memory_order_relaxed);
+    auto const head = head_.load(std::memory_order_relaxed);
+    return head > cursor ? std::min(head - cursor, capacity_) : 0;
+  }
+
+  [[nodiscard]] bool empty(const std::size_t consumer) const noexcept
+  {
+    return size(consumer) == 0;
+  }
+
+  [[nodiscard]] std::size_t capacity() const noexcept { return capacity_; }
+
+  [[nodiscard]] std::size_t consumer_count() const noexcept
+  {
+    return consumers_;
+  }
+};
+}// namespace dro
+#endif
@@ -0,0 +1,212 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// dro::MPMC_Queue with an eventfd that consumers can multiplex with sockets in
+// an epoll or io_uring event loop instead of spinning in pop().
+//
+// A consumer that runs out of elements announces that it is going to sleep
+// with arm(), waits for fd() to become readable and calls disarm() when it
+// wakes up. Producers only write the eventfd while a consumer is armed and the
+// eventfd was not written since the last disarm(), so an awake consumer costs
+// a push a compiler barrier and one load, and a burst of pushes costs one
+// syscall. arm() pays for the handshake with a membarrier, see
+// asymmetric-fence.hpp.
+//
+// Consumer event loop:
+//   while (queue.try_pop(val)) { handle(val); }
+//   if (queue.arm()) { epoll_wait(...); queue.disarm(); }
+//
+// Every armed consumer is woken, at least one of them sees the element.
+
+#ifndef DRO_EVENT_QUEUE
+#define DRO_EVENT_QUEUE
+
+#include "dro/asymmetric-fence.hpp"
+#include "dro/mpmc-queue.hpp"
+
+#include <atomic>       // for atomic, memory_order
+#include <cerrno>       // for errno
+#include <cstddef>      // for size_t, ptrdiff_t
+#include <cstdint>      // for uint64_t
+#include <iterator>     // for input_iterator, output_iterator
+#include <memory>       // for allocator
+#include <poll.h>       // for poll, pollfd
+#include <sys/eventfd.h>// for eventfd
+#include <system_error> // for system_error
+#include <unistd.h>     // for close, read, write
+#include <utility>      // for forward
+
+namespace dro
+{
+
+template <MPMC_Type T, typename Allocator = std::allocator<Slot<T>>,
+          MPMC_Policy... Policies>
+class MPMC_EventQueue
+{
+public:
+  using queue_type = MPMC_Queue<T, Allocator, Policies...>;
+  using value_type = T;
+
+private:
+  queue_type queue_;
+  int fd_;
+  // Armed consumers and whether the eventfd was written since the last
+  // disarm(), read by every push
+  alignas(cacheLineSize) std::atomic<std::size_t> sleepers_ {0};
+  std::atomic<bool> notified_ {false};
+
+  void notify() noexcept
+  {
+    // Orders the push before the load, pairs with the heavy fence in arm()
+    details::asymmetric_fence_light();
+    if (sleepers_.load(std::memory_order_relaxed) != 0 &&
+        ! notified_.load(std::memory_order_relaxed) &&
+        ! notified_.exchange(true, std::memory_order_relaxed))
+    {
+      std::uint64_t const one {1};
+      [[maybe_unused]] auto const written = ::write(fd_, &one, sizeof(one));
+    }
+  }
+
+public:
+  explicit MPMC_EventQueue(const std::size_t capacity,
+                           const Allocator& allocator = Allocator())
+      : queue_(capacity, allocator),
+        fd_(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+  {
+    if (fd_ < 0)
+    {
+      throw std::system_error(errno, std::system_category(), "eventfd");
+    }
+    // Registers the membarrier off the push path
+    static_cast<void>(details::membarrier_available());
+  }
+
+  // non-copyable and non-movable
+  MPMC_EventQueue(const MPMC_EventQueue& lhs)        = delete;
+  MPMC_EventQueue(MPMC_EventQueue&& lhs)             = delete;
+  MPMC_EventQueue& operator=(const MPMC_EventQueue&) = delete;
+  MPMC_EventQueue& operator=(MPMC_EventQueue&&)      = delete;
+
+  ~MPMC_EventQueue() { ::close(fd_); }
+
+  template <typename... Args>
+    requires std::constructible_from<T, Args...>
+  void emplace(Args&&... args) noexcept(MPMC_NoThrow_Type<T, Args&&...>)
+  {
+    queue_.emplace(std::forward<Args>(args)...);
+    notify();
+  }
+
+  template <typename... Args>
+    requires std::constructible_from<T, Args...>
+  [[nodiscard]] bool
+  try_emplace(Args&&... args) noexcept(MPMC_NoThrow_Type<T, Args&&...>)
+  {
+    if (! queue_.try_emplace(std::forward<Args>(args)...))
+    {
+      return false;
+    }
+    notify();
+    return true;
+  }
+
+  void push(const T& val) noexcept(MPMC_NoThrow_Type<T>) { emplace(val); }
+
+  template <typename P>
+    requires std::constructible_from<T, P&&>
+  void push(P&& val) noexcept(MPMC_NoThrow_Type<T, P&&>)
+  {
+    emplace(std::forward<P>(val));
+  }
+
+  [[nodiscard]] bool try_push(const T& val) noexcept(MPMC_NoThrow_Type<T>)
+  {
+    return try_emplace(val);
+  }
+
+  template <typename P>
+    requires std::constructible_from<T, P&&>
+  [[nodiscard]] bool try_push(P&& val) noexcept(MPMC_NoThrow_Type<T, P&&>)
+  {
+    return try_emplace(std::forward<P>(val));
+  }
+
+  // One notification for the whole run. There is no blocking push_bulk(), a
+  // range larger than the capacity would wait for a consumer that has not
+  // been notified yet.
+  template <std::input_iterator It, std::sized_sentinel_for<It> S>
+    requires std::constructible_from<T, std::iter_reference_t<It>>
+  [[nodiscard]] std::size_t try_push_bulk(It first, S last) noexcept(
+      MPMC_NoThrow_Type<T, std::iter_reference_t<It>>)
+  {
+    auto const count = queue_.try_push_bulk(first, last);
+    if (count != 0)
+    {
+      notify();
+    }
+    return count;
+  }
+
+  [[nodiscard]] bool try_pop(T& val) noexcept { return queue_.try_pop(val); }
+
+  template <std::output_iterator<T> It>
+  [[nodiscard]] std::size_t try_pop_bulk(It out, std::size_t maxCount) noexcept
+  {
+    return queue_.try_pop_bulk(out, maxCount);
+  }
+
+  // Sleeps in poll() on the eventfd while the queue is empty
+  void pop(T& val) noexcept
+  {
+    while (! try_pop(val))
+    {
+      if (arm())
+      {
+        pollfd event {fd_, POLLIN, 0};
+        [[maybe_unused]] auto const ready = ::poll(&event, 1, -1);
+        disarm();
+      }
+    }
+  }
+
+  // Announces that the calling consumer is about to wait on fd(). Returns
+  // false if the queue is not empty, the consumer is then not armed and should
+  // try_pop() again.
+  [[nodiscard]] bool arm() noexcept
+  {
+    sleepers_.fetch_add(1, std::memory_order_relaxed);
+    // Orders the announcement before the check, pairs with the light fence in
+    // notify()
+    details::asymmetric_fence_heavy();
+    if (! queue_.empty())
+    {
+      sleepers_.fetch_sub(1, std::memory_order_relaxed);
+      return false;
+    }
+    return true;
+  }
+
+  // Called by an armed consumer once it wakes up, before it pops again
+  void disarm() noexcept
+  {
+    std::uint64_t count {};
+    [[maybe_unused]] auto const bytes = ::read(fd_, &count, sizeof(count));
+    notified_.store(false, std::memory_order_relaxed);
+    sleepers_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  // Readable while a notification is pending, register it for EPOLLIN or
+  // with an io_uring poll or read request
+  [[nodiscard]] int fd() const noexcept { return fd_; }
+
+  [[nodiscard]] std::ptrdiff_t size() const noexcept { return queue_.size(); }
+
+  [[nodiscard]] bool empty() const noexcept { return queue_.empty(); }
+
+  [[nodiscard]] std::size_t capacity() const noexcept
+  {
+    return queue_.capacity();
+  }
+};
+}// namespace dro
+#endif
@@ -0,0 +1,261 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// Slot buffer allocators for dro::MPMC_Queue, used as the Allocator template
+// argument. Large queues span millions of 4 KiB pages and miss the dTLB on
+// most slot accesses, these allocators map the buffer with huge pages.
+//
+// 1) HugePageAllocator maps explicit huge pages with MAP_HUGETLB and falls
+//    back to a 2 MiB aligned mapping advised with MADV_HUGEPAGE for
+//    transparent huge pages when none are reserved.
+// 2) NumaAllocator maps the buffer the same way, binds it to one NUMA node
+//    with mbind and pre-faults every page so that no slot is first touched on
+//    the node of the constructing thread.
+// 3) ZeroedPageAllocator maps plain anonymous pages, which the kernel only
+//    faults in on first touch.
+//
+// All three return zero filled memory and declare zeroed. MPMC_Queue then
+// skips constructing the slots of a trivially default constructible and
+// destructible T, so a queue is created in O(1) and MPMC_Queue::prefault()
+// can fault it in later.
+//
+// Example:
+//   using Alloc = dro::NumaAllocator<dro::Slot<int>>;
+//   dro::MPMC_Queue<int, Alloc> queue(capacity, Alloc(node));
+
+#ifndef DRO_HUGE_PAGE_ALLOCATOR
+#define DRO_HUGE_PAGE_ALLOCATOR
+
+#include <array>       // for array
+#include <cerrno>      // for errno
+#include <cstddef>     // for size_t
+#include <cstdint>     // for uintptr_t
+#include <limits>      // for numeric_limits
+#include <new>         // for bad_alloc, bad_array_new_length
+#include <stdexcept>   // for logic_error
+#include <sys/mman.h>  // for mmap, munmap, madvise
+#include <sys/syscall.h>// for SYS_mbind
+#include <system_error>// for system_error
+#include <unistd.h>    // for syscall, sysconf
+
+namespace dro
+{
+
+namespace details
+{
+// Default huge page size on x86_64 and aarch64 with 4 KiB base pages
+static constexpr std::size_t hugePageSize = 2 * 1024 * 1024;
+
+// Mapping and unmapping round the same way, deallocate() only needs the size
+[[nodiscard]] inline std::size_t huge_page_bytes(std::size_t bytes) noexcept
+{
+  return (bytes + hugePageSize - 1) / hugePageSize * hugePageSize;
+}
+
+template <typename T> [[nodiscard]] std::size_t allocation_bytes(std::size_t n)
+{
+  if (n > std::numeric_limits<std::size_t>::max() / sizeof(T) - hugePageSize)
+  {
+    throw std::bad_array_new_length();
+  }
+  return huge_page_bytes(n * sizeof(T));
+}
+
+template <typename T> [[nodiscard]] std::size_t page_bytes(std::size_t n)
+{
+  if (n > std::numeric_limits<std::size_t>::max() / sizeof(T))
+  {
+    throw std::bad_array_new_length();
+  }
+  return n * sizeof(T);
+}
+
+[[nodiscard]] inline void* map_pages(std::size_t bytes)
+{
+  void* ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED)
+  {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+[[nodiscard]] inline void* map_huge_pages(std::size_t bytes)
+{
+  void* ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (ptr != MAP_FAILED)
+  {
+    return ptr;
+  }
+  // Transparent huge pages need 2 MiB aligned memory, over allocate and trim
+  auto const total = bytes + hugePageSize;
+  ptr = mmap(nullptr, total, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED)
+  {
+    throw std::bad_alloc();
+  }
+  auto* const base    = static_cast<char*>(ptr);
+  auto const misalign = reinterpret_cast<std::uintptr_t>(base) % hugePageSize;
+  auto const head     = misalign ? hugePageSize - misalign : 0;
+  if (head)
+  {
+    munmap(base, head);
+  }
+  munmap(base + head + bytes, hugePageSize - head);
+  // Advisory only, kernels without THP still return usable memory
+  madvise(base + head, bytes, MADV_HUGEPAGE);
+  return base + head;
+}
+
+inline void unmap_huge_pages(void* ptr, std::size_t bytes) noexcept
+{
+  munmap(ptr, bytes);
+}
+
+// MPOL_BIND from <linux/mempolicy.h>, the raw syscall avoids linking libnuma
+static constexpr int mpolBind = 2;
+
+inline void bind_to_node(void* ptr, std::size_t bytes, int node)
+{
+  constexpr std::size_t wordBits = std::numeric_limits<unsigned long>::digits;
+  std::array<unsigned long, 16> mask {};
+  if (node < 0 || static_cast<std::size_t>(node) >= mask.size() * wordBits)
+  {
+    throw std::logic_error("NUMA node is out of range");
+  }
+  mask[static_cast<std::size_t>(node) / wordBits] =
+      1UL << (static_cast<std::size_t>(node) % wordBits);
+  if (syscall(SYS_mbind, ptr, bytes, mpolBind, mask.data(),
+              mask.size() * wordBits + 1, 0) != 0)
+  {
+    throw std::system_error(errno, std::generic_category(), "mbind");
+  }
+}
+
+// Writes one byte per base page so that the kernel places every page now
+inline void prefault_pages(void* ptr, std::size_t bytes) noexcept
+{
+  auto const pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+  auto* const base    = static_cast<volatile char*>(ptr);
+  for (std::size_t i {}; i < bytes; i += pageSize) { base[i] = 0; }
+}
+}// namespace details
+
+template <typename T> class HugePageAllocator
+{
+public:
+  using value_type = T;
+
+  static constexpr bool zeroed = true;
+
+  HugePageAllocator() noexcept = default;
+
+  template <typename U>
+  HugePageAllocator(const HugePageAllocator<U>&) noexcept
+  {
+  }
+
+  [[nodiscard]] T* allocate(std::size_t n)
+  {
+    return static_cast<T*>(
+        details::map_huge_pages(details::allocation_bytes<T>(n)));
+  }
+
+  void deallocate(T* ptr, std::size_t n) noexcept
+  {
+    details::unmap_huge_pages(ptr, details::huge_page_bytes(n * sizeof(T)));
+  }
+
+  template <typename U>
+  [[nodiscard]] bool operator==(const HugePageAllocator<U>&) const noexcept
+  {
+    return true;
+  }
+};
+
+template <typename T> class NumaAllocator
+{
+private:
+  int node_ {};
+
+  template <typename U> friend class NumaAllocator;
+
+public:
+  using value_type = T;
+
+  static constexpr bool zeroed = true;
+
+  explicit NumaAllocator(int node = 0) noexcept : node_(node) {}
+
+  template <typename U>
+  NumaAllocator(const NumaAllocator<U>& other) noexcept
+      : node_(other.node_)
+  {
+  }
+
+  [[nodiscard]] T* allocate(std::size_t n)
+  {
+    auto const bytes = details::allocation_bytes<T>(n);
+    void* ptr        = details::map_huge_pages(bytes);
+    try
+    {
+      details::bind_to_node(ptr, bytes, node_);
+    }
+    catch (...)
+    {
+      details::unmap_huge_pages(ptr, bytes);
+      throw;
+    }
+    details::prefault_pages(ptr, bytes);
+    return static_cast<T*>(ptr);
+  }
+
+  void deallocate(T* ptr, std::size_t n) noexcept
+  {
+    details::unmap_huge_pages(ptr, details::huge_page_bytes(n * sizeof(T)));
+  }
+
+  [[nodiscard]] int node() const noexcept { return node_; }
+
+  template <typename U>
+  [[nodiscard]] bool operator==(const NumaAllocator<U>& other) const noexcept
+  {
+    return node_ == other.node_;
+  }
+};
+
+// Page aligned, so any slot alignment up to the page size is met
+template <typename T> class ZeroedPageAllocator
+{
+public:
+  using value_type = T;
+
+  static constexpr bool zeroed = true;
+
+  ZeroedPageAllocator() noexcept = default;
+
+  template <typename U>
+  ZeroedPageAllocator(const ZeroedPageAllocator<U>&) noexcept
+  {
+  }
+
+  [[nodiscard]] T* allocate(std::size_t n)
+  {
+    return static_cast<T*>(details::map_pages(details::page_bytes<T>(n)));
+  }
+
+  void deallocate(T* ptr, std::size_t n) noexcept
+  {
+    munmap(ptr, n * sizeof(T));
+  }
+
+  template <typename U>
+  [[nodiscard]] bool operator==(const ZeroedPageAllocator<U>&) const noexcept
+  {
+    return true;
+  }
+};
+}// namespace dro
+#endif
@@ -0,0 +1,224 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// Fixed size, allocation free queue payloads.
+//
+// 1) InplaceFunction<R(Args...), Capacity> is a move only std::function that
+//    stores the callable in Capacity bytes and never allocates.
+// 2) InplaceAny<Capacity> holds a value of any type that fits in Capacity
+//    bytes, e.g. one of several message types.
+//
+// Stored types must be nothrow move constructible and aligned to at most
+// alignof(void*), so moves are noexcept and both types satisfy MPMC_Type and
+// MPMC_NoThrow_Type. An oversized type fails to compile instead of falling
+// back to the heap.
+//
+// inplaceCapacity<SlotSize> is the Capacity that fills a SlotSize byte
+// dro::Slot together with the turn, the defaults fill one cache line.
+
+#ifndef DRO_INPLACE_FUNCTION
+#define DRO_INPLACE_FUNCTION
+
+#include "dro/mpmc-queue.hpp"
+
+#include <concepts>   // for same_as
+#include <cstddef>    // for size_t, byte
+#include <functional> // for invoke_r
+#include <new>        // for placement new, launder
+#include <type_traits>// for decay_t, is_invocable_r_v
+#include <utility>    // for exchange, forward, move
+
+namespace dro
+{
+
+// Storage left in a SlotSize byte slot after the turn and the operations
+// pointer
+template <std::size_t SlotSize>
+  requires(SlotSize > 2 * sizeof(void*))
+inline constexpr std::size_t inplaceCapacity = SlotSize - 2 * sizeof(void*);
+
+namespace details
+{
+template <typename T, std::size_t Capacity>
+concept inplace_storable = sizeof(T) <= Capacity &&
+                           alignof(T) <= alignof(void*) &&
+                           std::is_nothrow_move_constructible_v<T>;
+
+// Move constructs into the destination and destroys the source
+template <typename T> void inplace_relocate(void* dst, void* src) noexcept
+{
+  new (dst) T(std::move(*std::launder(static_cast<T*>(src))));
+  std::launder(static_cast<T*>(src))->~T();
+}
+
+template <typename T> void inplace_destroy(void* ptr) noexcept
+{
+  std::launder(static_cast<T*>(ptr))->~T();
+}
+
+// Storage and lifetime shared by InplaceFunction and InplaceAny, Operations
+// starts with the relocate and destroy pointers
+template <std::size_t Capacity, typename Operations> class inplace_storage
+{
+protected:
+  alignas(void*) std::byte storage_[Capacity];
+  const Operations* operations_ {};
+
+  template <typename T, typename... A>
+  void construct(const Operations* operations, A&&... args) noexcept(
+      std::is_nothrow_constructible_v<T, A&&...>)
+  {
+    new (storage_) T(std::forward<A>(args)...);
+    operations_ = operations;
+  }
+
+  template <typename T> [[nodiscard]] T* pointer() noexcept
+  {
+    return std::launder(reinterpret_cast<T*>(storage_));
+  }
+
+public:
+  inplace_storage() = default;
+
+  inplace_storage(inplace_storage&& other) noexcept
+  {
+    *this = std::move(other);
+  }
+
+  inplace_storage& operator=(inplace_storage&& other) noexcept
+  {
+    if (this != &other)
+    {
+      reset();
+      if (other.operations_)
+      {
+        other.operations_->relocate(storage_, other.storage_);
+        operations_ = std::exchange(other.operations_, nullptr);
+      }
+    }
+    return *this;
+  }
+
+  inplace_storage(const inplace_storage&)            = delete;
+  inplace_storage& operator=(const inplace_storage&) = delete;
+
+  ~inplace_storage() { reset(); }
+
+  void reset() noexcept
+  {
+    if (operations_)
+    {
+      std::exchange(operations_, nullptr)->destroy(storage_);
+    }
+  }
+
+  explicit operator bool() const noexcept { return operations_ != nullptr; }
+};
+
+template <typename R, typename... Args> struct function_operations
+{
+  void (*relocate)(void*, void*) noexcept;
+  void (*destroy)(void*) noexcept;
+  R (*invoke)(void*, Args&&...);
+};
+
+struct any_operations
+{
+  void (*relocate)(void*, void*) noexcept;
+  void (*destroy)(void*) noexcept;
+};
+}// namespace details
+
+template <typename Signature,
+          std::size_t Capacity = inplaceCapacity<cacheLineSize>>
+class InplaceFunction;
+
+template <typename R, typename... Args, std::size_t Capacity>
+class InplaceFunction<R(Args...), Capacity>
+    : public details::inplace_storage<
+          Capacity, details::function_operations<R, Args...>>
+{
+private:
+  using operations = details::function_operations<R, Args...>;
+
+  template <typename F>
+  static constexpr operations operations_for {
+      &details::inplace_relocate<F>, &details::inplace_destroy<F>,
+      [](void* f, Args&&... args) -> R {
+        return std::invoke_r<R>(*static_cast<F*>(f),
+                                std::forward<Args>(args)...);
+      }};
+
+public:
+  InplaceFunction() = default;
+
+  template <typename F>
+    requires(! std::same_as<std::decay_t<F>, InplaceFunction>) &&
+            std::is_invocable_r_v<R, std::decay_t<F>&, Args...>
+  InplaceFunction(F&& f) noexcept(
+      std::is_nothrow_constructible_v<std::decay_t<F>, F&&>)
+  {
+    using D = std::decay_t<F>;
+    static_assert(details::inplace_storable<D, Capacity>,
+                  "Callable must fit in Capacity bytes, be aligned to at most "
+                  "alignof(void*) and be nothrow move constructible");
+    this->template construct<D>(&operations_for<D>, std::forward<F>(f));
+  }
+
+  // Precondition: holds a callable
+  R operator()(Args... args)
+  {
+    return this->operations_->invoke(this->storage_,
+                                     std::forward<Args>(args)...);
+  }
+};
+
+template <std::size_t Capacity = inplaceCapacity<cacheLineSize>>
+class InplaceAny
+    : public details::inplace_storage<Capacity, details::any_operations>
+{
+private:
+  // The address of the operations identifies the stored type
+  template <typename T>
+  static constexpr details::any_operations operations_for {
+      &details::inplace_relocate<T>, &details::inplace_destroy<T>};
+
+public:
+  InplaceAny() = default;
+
+  template <typename T>
+    requires(! std::same_as<std::decay_t<T>, InplaceAny>)
+  InplaceAny(T&& val) noexcept(
+      std::is_nothrow_constructible_v<std::decay_t<T>, T&&>)
+  {
+    emplace<std::decay_t<T>>(std::forward<T>(val));
+  }
+
+  template <typename T, typename... A>
+  T& emplace(A&&... args) noexcept(std::is_nothrow_constructible_v<T, A&&...>)
+  {
+    static_assert(details::inplace_storable<T, Capacity>,
+                  "Type must fit in Capacity bytes, be aligned to at most "
+                  "alignof(void*) and be nothrow move constructible");
+    this->reset();
+    this->template construct<T>(&operations_for<T>, std::forward<A>(args)...);
+    return *this->template pointer<T>();
+  }
+
+  template <typename T> [[nodiscard]] bool holds() const noexcept
+  {
+    return this->operations_ == &operations_for<T>;
+  }
+
+  // nullptr unless the stored value is a T
+  template <typename T> [[nodiscard]] T* get_if() noexcept
+  {
+    return holds<T>() ? this->template pointer<T>() : nullptr;
+  }
+
+  [[nodiscard]] bool has_value() const noexcept
+  {
+    return this->operations_ != nullptr;
+  }
+};
+}// namespace dro
+#endif
@@ -11,19 +11,41 @@
 // 5) Removed turn alignment
 // 6) Added std::memory_order_relaxed for atomic fetch_add
 // 7) Completed size() function for wrap around case
+// 8) Added capacity policies for power of two mask / shift indexing
+// 9) Added packed slot layout with cache line index remapping
+// 10) Added bulk operations that claim a run of tickets with one atomic
+// 11) Added wait strategy policies for the blocking operations
+// 12) Added timed try_push / try_pop operations
+// 13) Added single producer / single consumer policies
+// 14) Added in place reserve / commit and acquire / release handles
+// 15) Relaxed index snapshots and weak compare exchange in the try paths
+// 16) Added an opt in sharded stats policy
+// 17) Added an opt in turn aligned slot layout
+// 18) Wrap safe size(), consistent occupancy() and an opt in occupancy hint
+// 19) Added close(), pushes fail and pops drain the queue and then fail
+// 20) O(1) construction on zero filled allocations and an explicit prefault()
+// 21) Direct payload copies and slot prefetching in the bulk operations
+// 22) Added an opt in ticket prefetch policy
 
 #ifndef DRO_MPMC_QUEUE
 #define DRO_MPMC_QUEUE
 
+#include <algorithm>     // for max
+#include <array>         // for array
 #include <atomic>        // for atomic, memory_order
-#include <bits/std_abs.h>// for abs
+#include <bit>           // for bit_ceil, countr_zero
+#include <chrono>        // for time_point, duration, steady_clock
 #include <concepts>      // for concept, requires
 #include <cstddef>       // for size_t, ptrdiff_t
+#include <cstring>       // for memcpy
+#include <iterator>      // for input_iterator, output_iterator
 #include <limits>        // for numeric_limits
 #include <memory>        // for allocator
 #include <new>           // for std::hardware_destructive_interference_size
+#include <optional>      // for optional
 #include <stdexcept>     // for logic_error
-#include <type_traits>   // for std::is_default_constructible
+#include <thread>        // for yield
+#include <type_traits>   // for std::is_default_constructible, conditional
 #include <utility>       // for forward
 
 namespace dro
@@ -48,116 +70,1041 @@ concept MPMC_NoThrow_Type =
     ((std::is_nothrow_copy_assignable_v<T> && std::is_copy_assignable_v<T>) ||
      (std::is_nothrow_move_assignable_v<T> && std::is_move_assignable_v<T>));
 
-template <MPMC_Type T> struct alignas(cacheLineSize) Slot
+// Policies are passed to MPMC_Queue as trailing template arguments in any
+// order. Each policy names its category, unspecified categories use the
+// default policy.
+template <typename P>
+concept MPMC_Policy = requires { typename P::policy_category; };
+
+// Allocators whose memory is zero filled declare static constexpr bool
+// zeroed = true, e.g. the mmap based allocators of huge-page-allocator.hpp
+template <typename A>
+concept MPMC_Zeroed_Allocator = requires { requires A::zeroed; };
+
+namespace details
+{
+template <typename Category, typename Default, typename... Policies>
+struct select_policy
+{
+  using type = Default;
+};
+
+template <typename Category, typename Default, typename Policy,
+          typename... Policies>
+struct select_policy<Category, Default, Policy, Policies...>
+    : std::conditional_t<
+          std::is_same_v<typename Policy::policy_category, Category>,
+          std::type_identity<Policy>,
+          select_policy<Category, Default, Policies...>>
+{
+};
+
+template <typename Category, typename Default, typename... Policies>
+using select_policy_t =
+    typename select_policy<Category, Default, Policies...>::type;
+}// namespace details
+
+struct capacity_policy
+{
+};
+
+// Capacity is used as given, index and turn require a division
+struct RuntimeCapacity
+{
+  using policy_category              = capacity_policy;
+  static constexpr bool power_of_two = false;
+  static constexpr std::size_t value = 0;
+};
+
+// Capacity is rounded up to a power of two at construction, index and turn
+// become a mask and a shift
+struct PowerOfTwoCapacity
+{
+  using policy_category              = capacity_policy;
+  static constexpr bool power_of_two = true;
+  static constexpr std::size_t value = 0;
+};
+
+// Capacity is a compile time constant rounded up to a power of two, index and
+// turn become a constant mask and shift
+template <std::size_t N>
+  requires(N > 0 && N <= (std::numeric_limits<std::size_t>::max() >> 1) + 1)
+struct FixedCapacity
+{
+  using policy_category              = capacity_policy;
+  static constexpr bool power_of_two = true;
+  static constexpr std::size_t value = std::bit_ceil(N);
+};
+
+struct wait_policy
+{
+};
+
+namespace details
+{
+inline void cpu_relax() noexcept
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield" ::: "memory");
+#endif
+}
+
+// Hints the cache line of ptr into the cache, with write intent when Write
+template <bool Write> inline void prefetch(const void* ptr) noexcept
+{
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(ptr, Write ? 1 : 0, 3);
+#else
+  static_cast<void>(ptr);
+#endif
+}
+}// namespace details
+
+// Wait policies return the number of failed turn checks, the spin count of
+// the stats policy
+
+// Busy spins on the turn with an empty loop body, lowest latency
+struct SpinWait
+{
+  using policy_category = wait_policy;
+
+  static std::size_t wait(const std::atomic<std::size_t>& turn,
+                          std::size_t expected) noexcept
+  {
+    std::size_t spins {};
+    while (turn.load(std::memory_order_acquire) != expected) { ++spins; }
+    return spins;
+  }
+
+  static void notify(std::atomic<std::size_t>&) noexcept {}
+};
+
+// Spins with a pause instruction, doubling the number of pauses after every
+// failed check up to MaxPauses. Frees execution resources for the SMT sibling.
+template <std::size_t MaxPauses = 64> struct BackoffWait
+{
+  using policy_category = wait_policy;
+
+  static std::size_t wait(const std::atomic<std::size_t>& turn,
+                          std::size_t expected) noexcept
+  {
+    std::size_t spins {};
+    std::size_t pauses {1};
+    while (turn.load(std::memory_order_acquire) != expected)
+    {
+      for (std::size_t i {}; i < pauses; ++i) { details::cpu_relax(); }
+      pauses = std::min(pauses * 2, MaxPauses);
+      ++spins;
+    }
+    return spins;
+  }
+
+  static void notify(std::atomic<std::size_t>&) noexcept {}
+};
+
+// Spins Spins times and then yields the thread to the scheduler between checks
+template <std::size_t Spins = 128> struct YieldWait
+{
+  using policy_category = wait_policy;
+
+  static std::size_t wait(const std::atomic<std::size_t>& turn,
+                          std::size_t expected) noexcept
+  {
+    std::size_t i {};
+    for (; turn.load(std::memory_order_acquire) != expected; ++i)
+    {
+      if (i < Spins)
+      {
+        details::cpu_relax();
+      }
+      else
+      {
+        std::this_thread::yield();
+      }
+    }
+    return i;
+  }
+
+  static void notify(std::atomic<std::size_t>&) noexcept {}
+};
+
+// Spins Spins times and then blocks with std::atomic::wait. Every turn update
+// calls notify_all, which only enters the kernel when a thread is blocked.
+template <std::size_t Spins = 128> struct BlockingWait
+{
+  using policy_category = wait_policy;
+
+  static std::size_t wait(const std::atomic<std::size_t>& turn,
+                          std::size_t expected) noexcept
+  {
+    for (std::size_t i {}; i < Spins; ++i)
+    {
+      if (turn.load(std::memory_order_acquire) == expected)
+      {
+        return i;
+      }
+      details::cpu_relax();
+    }
+    auto spins   = Spins;
+    auto current = turn.load(std::memory_order_acquire);
+    while (current != expected)
+    {
+      turn.wait(current, std::memory_order_acquire);
+      current = turn.load(std::memory_order_acquire);
+      ++spins;
+    }
+    return spins;
+  }
+
+  static void notify(std::atomic<std::size_t>& turn) noexcept
+  {
+    turn.notify_all();
+  }
+};
+
+template <MPMC_Type T, std::size_t Alignment = cacheLineSize,
+          std::size_t TurnAlignment = alignof(std::atomic<std::size_t>)>
+struct alignas(Alignment) Slot
 {
   T data_ {};
-  // This should not be aligned. Due to the aligned struct this doesn't cause
-  // cache contention. Alignment here would increase memory footprint.
-  std::atomic<std::size_t> turn {0};
+  // Unaligned by default. Due to the aligned struct this doesn't cause cache
+  // contention. Alignment here would increase memory footprint, see
+  // TurnAlignedSlots.
+  alignas(TurnAlignment) std::atomic<std::size_t> turn {0};
+
+  // data_ lives as long as the slot, the implicit destructor destroys it once
+  Slot()  = default;
+  ~Slot() = default;
+  Slot(const Slot&)            = delete;
+  Slot& operator=(const Slot&) = delete;
+  Slot(Slot&&)                 = delete;
+  Slot& operator=(Slot&&)      = delete;
+
+  void assign_value(T val) noexcept(MPMC_NoThrow_Type<T>)
+    requires std::is_copy_assignable_v<T> && (! std::is_move_assignable_v<T>)
+  {
+    data_ = val;
+  }
+
+  void assign_value(T val) noexcept(MPMC_NoThrow_Type<T>)
+    requires std::is_move_assignable_v<T>
+  {
+    data_ = std::move(val);
+  }
+
+  template <typename... Args>
+    requires std::constructible_from<T, Args...> &&
+             std::is_nothrow_constructible_v<T, Args...> &&
+             std::is_copy_assignable_v<T> && (! std::is_move_assignable_v<T>)
+  void assign_value(Args&&... args) noexcept(MPMC_NoThrow_Type<T, Args...>)
+  {
+    data_ = T(std::forward<Args>(args)...);
+  }
+
+  template <typename... Args>
+    requires std::constructible_from<T, Args...> &&
+             std::is_nothrow_constructible_v<T, Args...> &&
+             std::is_move_assignable_v<T>
+  void assign_value(Args&&... args) noexcept(MPMC_NoThrow_Type<T, Args...>)
+  {
+    data_ = std::move(T(std::forward<Args>(args)...));
+  }
+
+  // Copies straight from the source instead of through the by value
+  // parameter of assign_value, which costs a second copy of a large T
+  void copy_value(const T& val) noexcept
+    requires std::is_trivially_copyable_v<T>
+  {
+    std::memcpy(&data_, &val, sizeof(T));
+  }
+
+  T& return_value() noexcept(MPMC_NoThrow_Type<T>)
+    requires std::is_copy_assignable_v<T> && (! std::is_move_assignable_v<T>)
+  {
+    return data_;
+  }
+
+  T&& return_value() noexcept(MPMC_NoThrow_Type<T>)
+    requires std::is_move_assignable_v<T>
+  {
+    return std::move(data_);
+  }
+};
+
+struct producer_policy
+{
+};
+
+struct consumer_policy
+{
+};
+
+// Only one thread at a time may push
+struct SingleProducer
+{
+  using policy_category        = producer_policy;
+  static constexpr bool single = true;
+};
+
+struct MultiProducer
+{
+  using policy_category        = producer_policy;
+  static constexpr bool single = false;
+};
+
+// Only one thread at a time may pop
+struct SingleConsumer
+{
+  using policy_category        = consumer_policy;
+  static constexpr bool single = true;
+};
+
+struct MultiConsumer
+{
+  using policy_category        = consumer_policy;
+  static constexpr bool single = false;
+};
+
+struct layout_policy
+{
+};
+
+// Every slot occupies at least one cache line, neighbouring tickets never
+// share a cache line
+struct AlignedSlots
+{
+  using policy_category       = layout_policy;
+  static constexpr bool remap = false;
+  template <MPMC_Type T> using slot_type = Slot<T>;
+};
+
+// Slots are packed without padding and consecutive tickets are remapped onto
+// different cache lines, this avoids false sharing between neighbouring
+// producers without paying a cache line per slot. The capacity is rounded up
+// to a multiple of the slots per cache line.
+struct PackedSlots
+{
+  using policy_category       = layout_policy;
+  static constexpr bool remap = true;
+  template <MPMC_Type T>
+  using slot_type = Slot<T, std::max(alignof(T), alignof(std::size_t))>;
+};
+
+// The turn gets a cache line of its own, as in the original Rigtorp queue.
+// Waiters spinning on the turn don't share its line with the payload being
+// written, at the cost of a second cache line per slot.
+struct TurnAlignedSlots
+{
+  using policy_category       = layout_policy;
+  static constexpr bool remap = false;
+  template <MPMC_Type T>
+  using slot_type = Slot<T, cacheLineSize, cacheLineSize>;
+};
+
+struct stats_policy
+{
+};
+
+// Counters compile away
+struct NoStats
+{
+  using policy_category               = stats_policy;
+  static constexpr std::size_t shards = 0;
+};
+
+// Counters are spread over Shards cache lines, threads are assigned a shard
+// round robin on first use. Each thread updates its own line so the counters
+// add no contention up to Shards threads.
+template <std::size_t Shards = 16>
+  requires(Shards > 0)
+struct ShardedStats
+{
+  using policy_category               = stats_policy;
+  static constexpr std::size_t shards = Shards;
+};
+
+struct occupancy_policy
+{
+};
+
+// occupancy_hint() is not available
+struct NoOccupancyHint
+{
+  using policy_category                 = occupancy_policy;
+  static constexpr std::size_t interval = 0;
+};
+
+// Producers and consumers refresh a cached occupancy on its own cache line
+// every Interval tickets. occupancy_hint() is then one load of a rarely written
+// line, it lags the queue by up to Interval tickets on each side.
+template <std::size_t Interval = 64>
+  requires(Interval > 0)
+struct OccupancyHint
+{
+  using policy_category                 = occupancy_policy;
+  static constexpr std::size_t interval = Interval;
+};
+
+struct prefetch_policy
+{
+};
+
+// Slots are first touched after their ticket is claimed
+struct NoPrefetch
+{
+  using policy_category                 = prefetch_policy;
+  static constexpr std::size_t distance = 0;
+};
+
+// After claiming a ticket, a thread prefetches the slot Distance tickets ahead,
+// with write intent for producers. With one producer and one consumer that is
+// the slot the thread claims Distance operations later. With several threads
+// per side the slot often goes to another thread, so measure before enabling.
+template <std::size_t Distance = 4>
+  requires(Distance > 0)
+struct TicketPrefetch
+{
+  using policy_category                 = prefetch_policy;
+  static constexpr std::size_t distance = Distance;
+};
+
+// Snapshot of the counters, see MPMC_Queue::stats()
+struct MPMC_Stats
+{
+  std::size_t try_push_successes {};
+  std::size_t try_push_failures {};
+  std::size_t try_pop_successes {};
+  std::size_t try_pop_failures {};
+  // Compare exchange failures of the try operations
+  std::size_t cas_retries {};
+  // Failed turn checks while the blocking operations wait for a slot
+  std::size_t push_spins {};
+  std::size_t pop_spins {};
+  // Largest occupancy seen by a producer after a push
+  std::size_t high_water_mark {};
+};
+
+namespace details
+{
+// Tokens are handed out round robin on first use and a thread keeps its token
+// for its lifetime. Each role counts separately so that threads of one role
+// are spread evenly.
+template <typename Role> [[nodiscard]] std::size_t threadToken() noexcept
+{
+  static std::atomic<std::size_t> nextToken {0};
+  static thread_local const std::size_t token =
+      nextToken.fetch_add(1, std::memory_order_relaxed);
+  return token;
+}
+
+struct stats_token
+{
+};
+
+struct alignas(cacheLineSize) stats_shard
+{
+  std::atomic<std::size_t> try_push_successes {0};
+  std::atomic<std::size_t> try_push_failures {0};
+  std::atomic<std::size_t> try_pop_successes {0};
+  std::atomic<std::size_t> try_pop_failures {0};
+  std::atomic<std::size_t> cas_retries {0};
+  std::atomic<std::size_t> push_spins {0};
+  std::atomic<std::size_t> pop_spins {0};
+  std::atomic<std::size_t> high_water_mark {0};
+};
+
+using stats_counter = std::atomic<std::size_t> stats_shard::*;
+
+template <std::size_t Shards> class stats_storage
+{
+private:
+  std::array<stats_shard, Shards> shards_;
+
+  [[nodiscard]] stats_shard& local() noexcept
+  {
+    return shards_[threadToken<stats_token>() % Shards];
+  }
+
+public:
+  static constexpr bool enabled = true;
+
+  void add(stats_counter counter, std::size_t value) noexcept
+  {
+    if (value)
+    {
+      (local().*counter).fetch_add(value, std::memory_order_relaxed);
+    }
+  }
+
+  void high_water_mark(std::size_t occupancy) noexcept
+  {
+    auto& mark = local().high_water_mark;
+    if (occupancy > mark.load(std::memory_order_relaxed))
+    {
+      mark.store(occupancy, std::memory_order_relaxed);
+    }
+  }
+
+  [[nodiscard]] MPMC_Stats snapshot() const noexcept
+  {
+    MPMC_Stats stats;
+    for (auto const& shard : shards_)
+    {
+      auto const load = [&](stats_counter counter) {
+        return (shard.*counter).load(std::memory_order_relaxed);
+      };
+      stats.try_push_successes += load(&stats_shard::try_push_successes);
+      stats.try_push_failures += load(&stats_shard::try_push_failures);
+      stats.try_pop_successes += load(&stats_shard::try_pop_successes);
+      stats.try_pop_failures += load(&stats_shard::try_pop_failures);
+      stats.cas_retries += load(&stats_shard::cas_retries);
+      stats.push_spins += load(&stats_shard::push_spins);
+      stats.pop_spins += load(&stats_shard::pop_spins);
+      stats.high_water_mark = std::max(
+          stats.high_water_mark, load(&stats_shard::high_water_mark));
+    }
+    return stats;
+  }
+};
+
+template <> class stats_storage<0>
+{
+public:
+  static constexpr bool enabled = false;
+
+  void add(stats_counter, std::size_t) noexcept {}
+
+  void high_water_mark(std::size_t) noexcept {}
+
+  [[nodiscard]] MPMC_Stats snapshot() const noexcept { return {}; }
+};
+
+template <std::size_t Interval> class occupancy_storage
+{
+private:
+  alignas(cacheLineSize) std::atomic<std::size_t> hint_ {0};
+
+public:
+  static constexpr bool enabled = true;
+
+  // Whether the tickets [ticket, ticket + count) cross an interval
+  [[nodiscard]] static bool due(std::size_t ticket, std::size_t count) noexcept
+  {
+    return ticket / Interval != (ticket + count) / Interval;
+  }
+
+  void store(std::size_t occupancy) noexcept
+  {
+    hint_.store(occupancy, std::memory_order_relaxed);
+  }
+
+  [[nodiscard]] std::size_t load() const noexcept
+  {
+    return hint_.load(std::memory_order_relaxed);
+  }
+};
+
+template <> class occupancy_storage<0>
+{
+public:
+  static constexpr bool enabled = false;
+
+  [[nodiscard]] static bool due(std::size_t, std::size_t) noexcept
+  {
+    return false;
+  }
+
+  void store(std::size_t) noexcept {}
+};
+}// namespace details
+
+template <MPMC_Type T, typename Allocator = std::allocator<Slot<T>>,
+          MPMC_Policy... Policies>
+class alignas(cacheLineSize) MPMC_Queue
+{
+private:
+  using capacity_type =
+      details::select_policy_t<capacity_policy, RuntimeCapacity, Policies...>;
+  using layout_type =
+      details::select_policy_t<layout_policy, AlignedSlots, Policies...>;
+  using wait_type =
+      details::select_policy_t<wait_policy, SpinWait, Policies...>;
+  using producer_type =
+      details::select_policy_t<producer_policy, MultiProducer, Policies...>;
+  using consumer_type =
+      details::select_policy_t<consumer_policy, MultiConsumer, Policies...>;
+  using stats_type =
+      details::select_policy_t<stats_policy, NoStats, Policies...>;
+  using occupancy_type =
+      details::select_policy_t<occupancy_policy, NoOccupancyHint, Policies...>;
+  using prefetch_type =
+      details::select_policy_t<prefetch_policy, NoPrefetch, Policies...>;
+
+public:
+  using value_type     = T;
+  using slot_type      = typename layout_type::template slot_type<T>;
+  using allocator_type = typename std::allocator_traits<
+      Allocator>::template rebind_alloc<slot_type>;
+
+  static constexpr bool single_producer = producer_type::single;
+  static constexpr bool single_consumer = consumer_type::single;
+
+  // Grants in place access to the payload of a claimed slot. The slot is handed
+  // to the other side by commit() or release().
+  template <bool Producer> class slot_handle
+  {
+  private:
+    slot_type* slot_ {};
+    std::size_t turn_ {};
+
+    friend class MPMC_Queue;
+
+    slot_handle(slot_type* slot, std::size_t turn) noexcept
+        : slot_(slot), turn_(turn)
+    {
+    }
+
+  public:
+    slot_handle() = default;
+
+    // Empty when the queue is closed
+    [[nodiscard]] explicit operator bool() const noexcept
+    {
+      return slot_ != nullptr;
+    }
+
+    [[nodiscard]] T& operator*() const noexcept { return slot_->data_; }
+
+    [[nodiscard]] T* operator->() const noexcept { return &slot_->data_; }
+  };
+
+  using producer_handle = slot_handle<true>;
+  using consumer_handle = slot_handle<false>;
+
+private:
+
+  static constexpr std::size_t MAX_SIZE_T =
+      std::numeric_limits<std::size_t>::max();
+  // Attempts of occupancy() to read the head between two equal tails
+  static constexpr std::size_t MAX_OCCUPANCY_READS = 4;
+  static constexpr std::size_t MAX_POWER_OF_TWO = (MAX_SIZE_T >> 1) + 1;
+  // Set in the head by close(), tickets stay below 2^63
+  static constexpr std::size_t CLOSED_BIT = MAX_POWER_OF_TWO;
+  // Upper bound of failed attempts between clock reads of the timed operations
+  static constexpr std::size_t MAX_TIMED_SPINS = 256;
+  static constexpr std::size_t SLOTS_PER_LINE =
+      layout_type::remap ? std::bit_floor(std::max<std::size_t>(
+                               cacheLineSize / sizeof(slot_type), 1))
+                         : 1;
+  static constexpr std::size_t FIXED_CAPACITY =
+      capacity_type::value ? std::max(capacity_type::value, SLOTS_PER_LINE)
+                           : 0;
+  // Zero filled memory already holds value initialized slots of a trivially
+  // default constructible and destructible T with turn 0, the slots are not
+  // constructed or destroyed one by one and untouched pages stay unmapped
+  static constexpr bool ZEROED_SLOTS =
+      MPMC_Zeroed_Allocator<allocator_type> &&
+      std::is_trivially_default_constructible_v<T> &&
+      std::is_trivially_destructible_v<T>;
+  // Bytes between the writes of prefault(), the smallest base page size
+  static constexpr std::size_t PREFAULT_STRIDE = 4096;
+
+  std::size_t capacity_;
+  // Only used by PowerOfTwoCapacity, equal to log2(capacity_)
+  std::size_t shift_ {};
+  // Only used by PackedSlots, equal to capacity_ / SLOTS_PER_LINE
+  std::size_t lines_ {1};
+  allocator_type allocator_ [[no_unique_address]];
+  slot_type* buffer_;
+  // Ticket of the closed marker. Only written by close(), shares the cache
+  // line of the read only members so the pop path adds no contended load.
+  std::atomic<std::size_t> closedHead_ {MAX_SIZE_T};
+
+  alignas(cacheLineSize) std::atomic<std::size_t> tail_ {0};
+  alignas(cacheLineSize) std::atomic<std::size_t> head_ {0};
+  [[no_unique_address]] details::stats_storage<stats_type::shards> stats_;
+  [[no_unique_address]] details::occupancy_storage<occupancy_type::interval>
+      occupancy_;
+
+  [[nodiscard]] std::size_t turn(std::size_t ticket) const noexcept
+  {
+    if constexpr (FIXED_CAPACITY != 0)
+    {
+      return ticket >> std::countr_zero(FIXED_CAPACITY);
+    }
+    else if constexpr (capacity_type::power_of_two)
+    {
+      return ticket >> shift_;
+    }
+    else
+    {
+      return ticket / capacity_;
+    }
+  }
+
+  [[nodiscard]] std::size_t index(std::size_t ticket) const noexcept
+  {
+    if constexpr (FIXED_CAPACITY != 0)
+    {
+      return ticket & (FIXED_CAPACITY - 1);
+    }
+    else if constexpr (capacity_type::power_of_two)
+    {
+      return ticket & (capacity_ - 1);
+    }
+    else
+    {
+      return ticket % capacity_;
+    }
+  }
+
+  // Spreads consecutive indexes across cache lines, index i = q * n + r maps
+  // to r * lines + q where n is the number of slots per cache line
+  [[nodiscard]] slot_type& slot_at(std::size_t ticket) noexcept
+  {
+    auto const i = index(ticket);
+    if constexpr (SLOTS_PER_LINE == 1)
+    {
+      return buffer_[i];
+    }
+    else
+    {
+      return buffer_[(i & (SLOTS_PER_LINE - 1)) * lines_ +
+                     (i >> std::countr_zero(SLOTS_PER_LINE))];
+    }
+  }
+
+  [[nodiscard]] const slot_type& slot_at(std::size_t ticket) const noexcept
+  {
+    return const_cast<MPMC_Queue&>(*this).slot_at(ticket);
+  }
+
+  // Pulls every cache line of a slot the thread is about to use, so the turn
+  // and payload misses overlap with the work on the current slot
+  template <bool Write> static void prefetch_slot(const slot_type& slot) noexcept
+  {
+    auto const* const bytes = reinterpret_cast<const unsigned char*>(&slot);
+    for (std::size_t i {}; i < sizeof(slot_type); i += cacheLineSize)
+    {
+      details::prefetch<Write>(bytes + i);
+    }
+  }
+
+  // Only with TicketPrefetch, warms the slot of the ticket the prefetch
+  // distance ahead of a claimed ticket
+  template <bool Write> void prefetch_ahead(std::size_t ticket) noexcept
+  {
+    if constexpr (prefetch_type::distance != 0)
+    {
+      prefetch_slot<Write>(slot_at(ticket + prefetch_type::distance));
+    }
+  }
+
+  // A trivially copyable element of the queue type is copied straight from
+  // the range, the compiler widens the copy to the vector width of the target
+  template <typename Ref> static void write_slot(slot_type& slot, Ref&& ref)
+  {
+    if constexpr (std::is_trivially_copyable_v<T> &&
+                  std::is_same_v<std::remove_cvref_t<Ref>, T>)
+    {
+      slot.copy_value(ref);
+    }
+    else
+    {
+      slot.assign_value(std::forward<Ref>(ref));
+    }
+  }
+
+  // Retries op until it succeeds or the deadline passes. The clock is only
+  // read after an exponentially growing number of failed attempts.
+  template <typename Clock, typename Duration, typename Op>
+  [[nodiscard]] static bool
+  retry_until(const std::chrono::time_point<Clock, Duration>& deadline, Op&& op)
+  {
+    std::size_t spins {1};
+    while (true)
+    {
+      for (std::size_t i {}; i < spins; ++i)
+      {
+        if (op())
+        {
+          return true;
+        }
+        details::cpu_relax();
+      }
+      if (Clock::now() >= deadline)
+      {
+        return false;
+      }
+      spins = std::min(spins * 2, MAX_TIMED_SPINS);
+    }
+  }
+
+  // Distance of the slot from the turn of a ticket. Negative when the slot is
+  // still a lap behind, i.e. the queue was full / empty at the index snapshot.
+  // Positive when other threads have claimed the ticket and the snapshot is
+  // stale. The turn acquire orders the slot data, so the index itself is
+  // read relaxed and only reloaded when the snapshot is stale.
+  [[nodiscard]] static std::ptrdiff_t
+  turn_distance(const slot_type& slot, std::size_t expected) noexcept
+  {
+    return static_cast<std::ptrdiff_t>(
+        slot.turn.load(std::memory_order_acquire) - expected);
+  }
+
+  [[nodiscard]] std::size_t closed_head() const noexcept
+  {
+    return closedHead_.load(std::memory_order_relaxed);
+  }
+
+  // Head without the closed bit, the failed pushes after close() are not
+  // counted
+  [[nodiscard]] std::size_t open_head(std::size_t head) const noexcept
+  {
+    return head < CLOSED_BIT ? head
+                             : std::min(head - CLOSED_BIT, closed_head());
+  }
+
+  // Modulo 2^64 the ticket difference is exact while the head and tail are
+  // less than 2^63 apart, which always holds
+  [[nodiscard]] std::size_t clamp_occupancy(std::size_t head,
+                                            std::size_t tail) const noexcept
+  {
+    auto const distance = static_cast<std::ptrdiff_t>(open_head(head) - tail);
+    return distance <= 0 ? 0
+                         : std::min(static_cast<std::size_t>(distance),
+                                    capacity_);
+  }
+
+  // Refreshes the occupancy hint when a claim crosses an interval
+  void record_head(std::size_t head, std::size_t count) noexcept
+  {
+    if (decltype(occupancy_)::due(head, count))
+    {
+      occupancy_.store(clamp_occupancy(
+          head + count, tail_.load(std::memory_order_relaxed)));
+    }
+  }
+
+  void record_tail(std::size_t tail, std::size_t count) noexcept
+  {
+    if (decltype(occupancy_)::due(tail, count))
+    {
+      occupancy_.store(clamp_occupancy(head_.load(std::memory_order_relaxed),
+                                       tail + count));
+    }
+  }
+
+  // A single producer or consumer owns its counter, claiming tickets is a plain
+  // load and store instead of an atomic read modify write
+  [[nodiscard]] std::size_t fetch_add_head(std::size_t count) noexcept
+  {
+    std::size_t head;
+    if constexpr (single_producer)
+    {
+      head = head_.load(std::memory_order_relaxed);
+      head_.store(head + count, std::memory_order_relaxed);
+    }
+    else
+    {
+      head = head_.fetch_add(count, std::memory_order_relaxed);
+    }
+    record_head(head, count);
+    return head;
+  }
+
+  [[nodiscard]] std::size_t fetch_add_tail(std::size_t count) noexcept
+  {
+    std::size_t tail;
+    if constexpr (single_consumer)
+    {
+      tail = tail_.load(std::memory_order_relaxed);
+      tail_.store(tail + count, std::memory_order_relaxed);
+    }
+    else
+    {
+      tail = tail_.fetch_add(count, std::memory_order_relaxed);
+    }
+    record_tail(tail, count);
+    return tail;
+  }
+
+  [[nodiscard]] bool compare_exchange_head(std::size_t& head,
+                                           std::size_t next) noexcept
+  {
+    if constexpr (single_producer)
+    {
+      head_.store(next, std::memory_order_relaxed);
+      record_head(head, next - head);
+      return true;
+    }
+    else
+    {
+      if (head_.compare_exchange_weak(head, next, std::memory_order_relaxed,
+                                     std::memory_order_relaxed))
+      {
+        record_head(head, next - head);
+        return true;
+      }
+      stats_.add(&details::stats_shard::cas_retries, 1);
+      return false;
+    }
+  }
 
-  Slot() = default;
-  ~Slot()
+  [[nodiscard]] bool compare_exchange_tail(std::size_t& tail,
+                                           std::size_t next) noexcept
   {
-    if (turn.load(std::memory_order_acquire) & 1)
+    if constexpr (single_consumer)
+    {
+      tail_.store(next, std::memory_order_relaxed);
+      record_tail(tail, next - tail);
+      return true;
+    }
+    else
     {
-      destroy();
+      if (tail_.compare_exchange_weak(tail, next, std::memory_order_relaxed,
+                                     std::memory_order_relaxed))
+      {
+        record_tail(tail, next - tail);
+        return true;
+      }
+      stats_.add(&details::stats_shard::cas_retries, 1);
+      return false;
     }
   }
-  Slot(const Slot&)            = delete;
-  Slot& operator=(const Slot&) = delete;
-  Slot(Slot&&)                 = delete;
-  Slot& operator=(Slot&&)      = delete;
 
-  void assign_value(T val) noexcept(MPMC_NoThrow_Type<T>)
-    requires std::is_copy_assignable_v<T> && (! std::is_move_assignable_v<T>)
+  void producer_wait(const slot_type& slot, std::size_t expected) noexcept
   {
-    data_ = val;
+    stats_.add(&details::stats_shard::push_spins,
+               wait_type::wait(slot.turn, expected));
   }
 
-  void assign_value(T val) noexcept(MPMC_NoThrow_Type<T>)
-    requires std::is_move_assignable_v<T>
+  void consumer_wait(const slot_type& slot, std::size_t expected) noexcept
   {
-    data_ = std::move(val);
+    stats_.add(&details::stats_shard::pop_spins,
+               wait_type::wait(slot.turn, expected));
   }
 
-  template <typename... Args>
-    requires std::constructible_from<T, Args...> &&
-             std::is_nothrow_constructible_v<T, Args...> &&
-             std::is_copy_assignable_v<T> && (! std::is_move_assignable_v<T>)
-  void assign_value(Args&&... args) noexcept(MPMC_NoThrow_Type<T, Args...>)
+  void record_try_push(bool success) noexcept
   {
-    data_ = T(std::forward<Args>(args)...);
+    stats_.add(success ? &details::stats_shard::try_push_successes
+                       : &details::stats_shard::try_push_failures,
+               1);
   }
 
-  template <typename... Args>
-    requires std::constructible_from<T, Args...> &&
-             std::is_nothrow_constructible_v<T, Args...> &&
-             std::is_move_assignable_v<T>
-  void assign_value(Args&&... args) noexcept(MPMC_NoThrow_Type<T, Args...>)
+  void record_try_pop(bool success) noexcept
   {
-    data_ = std::move(T(std::forward<Args>(args)...));
+    stats_.add(success ? &details::stats_shard::try_pop_successes
+                       : &details::stats_shard::try_pop_failures,
+               1);
   }
 
-  T& return_value() noexcept(MPMC_NoThrow_Type<T>)
-    requires std::is_copy_assignable_v<T> && (! std::is_move_assignable_v<T>)
+  // Occupancy once the tickets before next are pushed. Reads the consumer
+  // index, so only with a stats policy.
+  void record_occupancy(std::size_t next) noexcept
   {
-    return data_;
+    if constexpr (decltype(stats_)::enabled)
+    {
+      auto const tail = tail_.load(std::memory_order_relaxed);
+      stats_.high_water_mark(next > tail ? next - tail : 0);
+    }
   }
 
-  T&& return_value() noexcept(MPMC_NoThrow_Type<T>)
-    requires std::is_move_assignable_v<T>
+  void store_turn(slot_type& slot, std::size_t value) noexcept
   {
-    return std::move(data_);
+    slot.turn.store(value, std::memory_order_release);
+    wait_type::notify(slot.turn);
   }
 
-  void destroy() noexcept { data_.~T(); }
-};
-
-template <MPMC_Type T, typename Allocator = std::allocator<Slot<T>>>
-class alignas(cacheLineSize) MPMC_Queue
-{
-private:
-  std::size_t capacity_;
-  Allocator allocator_ [[no_unique_address]];
-  Slot<T>* buffer_;
-  static constexpr std::size_t MAX_SIZE_T =
-      std::numeric_limits<std::size_t>::max();
-  static constexpr std::ptrdiff_t MAX_PTRDIFF_T =
-      std::numeric_limits<std::ptrdiff_t>::max();
-
-  alignas(cacheLineSize) std::atomic<std::size_t> tail_ {0};
-  alignas(cacheLineSize) std::atomic<std::size_t> head_ {0};
+  // The slot of a ticket at or after the closed head holds the closed marker
+  // instead of an element. The consumer frees the slot and passes the marker
+  // to the next ticket, which only a consumer can hold.
+  void pass_closed(slot_type& slot, std::size_t ticket) noexcept
+  {
+    store_turn(slot, turn(ticket) * 2 + 2);
+    auto& next = slot_at(ticket + 1);
+    producer_wait(next, turn(ticket + 1) * 2);
+    store_turn(next, turn(ticket + 1) * 2 + 1);
+  }
 
-  [[nodiscard]] std::size_t turn(size_t index) const noexcept
+  void allocate_buffer()
   {
-    return index / capacity_;
+    lines_ = capacity_ / SLOTS_PER_LINE;
+    // ++capacity_;// prevents live lock e.g. reader and writer share 1 slot for
+    // size 1
+    buffer_ = allocator_.allocate(capacity_ + 1);
+    if constexpr (ZEROED_SLOTS)
+    {
+      // The slots are used without a constructor call. Slot holds a
+      // std::atomic and is not an implicit lifetime type, so this is outside
+      // the object model and relies on the compiler treating zero bytes as a
+      // live slot, as GCC and Clang do. The asserts pin down what makes the
+      // zero bytes equal to a constructed slot: the turn is a lock free
+      // atomic with the representation of size_t and starts at 0, the
+      // payload is never read before a push writes it and no destructor has
+      // to run. Placement new would write every turn and map every page.
+      static_assert(std::atomic<std::size_t>::is_always_lock_free);
+      static_assert(sizeof(std::atomic<std::size_t>) == sizeof(std::size_t));
+      static_assert(std::is_standard_layout_v<std::atomic<std::size_t>>);
+      static_assert(std::is_trivially_destructible_v<slot_type>);
+    }
+    else
+    {
+      for (size_t i {}; i < capacity_; ++i) { new (&buffer_[i]) slot_type(); }
+    }
   }
 
 public:
   explicit MPMC_Queue(const std::size_t capacity,
                       const Allocator& allocator = Allocator())
-      : capacity_(capacity), allocator_(allocator)
+    requires(FIXED_CAPACITY == 0)
+      : capacity_(capacity), allocator_(allocator_type(allocator))
   {
     // Capacity cannot be negative
     if (capacity_ < 1)
     {
       throw std::logic_error("Capacity must be positive");
     }
+    if constexpr (capacity_type::power_of_two)
+    {
+      if (capacity_ > MAX_POWER_OF_TWO)
+      {
+        throw std::logic_error("Capacity exceeds largest power of two");
+      }
+      capacity_ = std::bit_ceil(capacity_);
+    }
     // - 1 is for the ++capacity_ argument (rare overflow edge case)
-    if (capacity_ == MAX_SIZE_T)
+    else if (capacity_ >= MAX_SIZE_T - SLOTS_PER_LINE)
     {
-      capacity_ = MAX_SIZE_T - 1;
+      capacity_ = MAX_SIZE_T - SLOTS_PER_LINE;
     }
-    // ++capacity_;// prevents live lock e.g. reader and writer share 1 slot for
-    // size 1
-    buffer_ = allocator_.allocate(capacity_ + 1);
-    for (size_t i {}; i < capacity_; ++i) { new (&buffer_[i]) Slot<T>(); }
+    // Remapping requires whole cache lines of slots
+    capacity_ = (capacity_ + SLOTS_PER_LINE - 1) / SLOTS_PER_LINE *
+                SLOTS_PER_LINE;
+    if constexpr (capacity_type::power_of_two)
+    {
+      shift_ = std::countr_zero(capacity_);
+    }
+    allocate_buffer();
+  }
+
+  explicit MPMC_Queue(const Allocator& allocator = Allocator())
+    requires(FIXED_CAPACITY != 0)
+      : capacity_(FIXED_CAPACITY), allocator_(allocator_type(allocator))
+  {
+    allocate_buffer();
   }
 
   ~MPMC_Queue() noexcept
   {
-    for (size_t i {}; i < capacity_; ++i) { buffer_[i].~Slot(); }
-    allocator_.deallocate(buffer_, capacity_ - 1);
+    // Unconstructed zero filled slots have no lifetime to end
+    if constexpr (! ZEROED_SLOTS)
+    {
+      for (size_t i {}; i < capacity_; ++i) { buffer_[i].~slot_type(); }
+    }
+    allocator_.deallocate(buffer_, capacity_ + 1);
   }
 
   // non-copyable and non-movable
@@ -166,15 +1113,23 @@ public:
   MPMC_Queue& operator=(const MPMC_Queue&) = delete;
   MPMC_Queue& operator=(MPMC_Queue&&)      = delete;
 
+  // Returns false once the queue is closed
   template <typename... Args>
     requires std::constructible_from<T, Args...>
-  void emplace(Args&&... args) noexcept(MPMC_NoThrow_Type<T, Args&&...>)
+  bool emplace(Args&&... args) noexcept(MPMC_NoThrow_Type<T, Args&&...>)
   {
-    auto const head = head_.fetch_add(1, std::memory_order_relaxed);
-    auto& slot      = buffer_[head % capacity_];
-    while (turn(head) * 2 != slot.turn.load(std::memory_order_acquire)) {}
+    auto const head = fetch_add_head(1);
+    if (head >= CLOSED_BIT)
+    {
+      return false;
+    }
+    auto& slot = slot_at(head);
+    prefetch_ahead<true>(head);
+    record_occupancy(head + 1);
+    producer_wait(slot, turn(head) * 2);
     slot.assign_value(std::forward<Args>(args)...);
-    slot.turn.store(turn(head) * 2 + 1, std::memory_order_release);
+    store_turn(slot, turn(head) * 2 + 1);
+    return true;
   }
 
   template <typename... Args>
@@ -182,38 +1137,50 @@ public:
   [[nodiscard]] bool try_emplace(Args&&... args) noexcept(
       MPMC_NoThrow_Type<T, Args&&...>)
   {
-    auto head = head_.load(std::memory_order_acquire);
+    auto head = head_.load(std::memory_order_relaxed);
     while (true)
     {
-      auto& slot = buffer_[head % capacity_];
-      if (turn(head) * 2 == slot.turn.load(std::memory_order_acquire))
+      if (head >= CLOSED_BIT)
       {
-        if (head_.compare_exchange_strong(head, head + 1))
+        record_try_push(false);
+        return false;
+      }
+      auto& slot          = slot_at(head);
+      auto const distance = turn_distance(slot, turn(head) * 2);
+      if (distance == 0)
+      {
+        if (compare_exchange_head(head, head + 1))
         {
+          prefetch_ahead<true>(head);
           slot.assign_value(std::forward<Args>(args)...);
-          slot.turn.store(turn(head) * 2 + 1, std::memory_order_release);
+          store_turn(slot, turn(head) * 2 + 1);
+          record_occupancy(head + 1);
+          record_try_push(true);
           return true;
         }
       }
+      else if (distance < 0)
+      {
+        record_try_push(false);
+        return false;
+      }
       else
       {
-        auto const prevHead = head;
-        head                = head_.load(std::memory_order_acquire);
-        if (head == prevHead)
-        {
-          return false;
-        }
+        head = head_.load(std::memory_order_relaxed);
       }
     }
   }
 
-  void push(const T& val) noexcept(MPMC_NoThrow_Type<T>) { emplace(val); }
+  bool push(const T& val) noexcept(MPMC_NoThrow_Type<T>)
+  {
+    return emplace(val);
+  }
 
   template <typename P>
     requires std::constructible_from<T, P&&>
-  void push(P&& val) noexcept(MPMC_NoThrow_Type<T, P&&>)
+  bool push(P&& val) noexcept(MPMC_NoThrow_Type<T, P&&>)
   {
-    emplace(std::forward<P>(val));
+    return emplace(std::forward<P>(val));
   }
 
   [[nodiscard]] bool try_push(const T& val) noexcept(MPMC_NoThrow_Type<T>)
@@ -228,63 +1195,519 @@ public:
     return try_emplace(std::forward<P>(val));
   }
 
-  void pop(T& val) noexcept
+  // Claims one ticket per element with a single fetch_add, each slot is
+  // published as soon as it is written. Pushes nothing and returns false once
+  // the queue is closed.
+  template <std::input_iterator It, std::sized_sentinel_for<It> S>
+    requires std::constructible_from<T, std::iter_reference_t<It>>
+  bool push_bulk(It first, S last) noexcept(
+      MPMC_NoThrow_Type<T, std::iter_reference_t<It>>)
+  {
+    auto const count = static_cast<std::size_t>(last - first);
+    auto const head  = fetch_add_head(count);
+    if (head >= CLOSED_BIT)
+    {
+      return false;
+    }
+    record_occupancy(head + count);
+    auto* next = count ? &slot_at(head) : nullptr;
+    for (std::size_t i {}; i < count; ++i, ++first)
+    {
+      auto& slot = *next;
+      if (i + 1 < count)
+      {
+        next = &slot_at(head + i + 1);
+        prefetch_slot<true>(*next);
+      }
+      producer_wait(slot, turn(head + i) * 2);
+      write_slot(slot, *first);
+      store_turn(slot, turn(head + i) * 2 + 1);
+    }
+    return true;
+  }
+
+  // Claims the run of consecutive free slots at the head, up to the size of
+  // the range, with a single compare exchange. Returns the number of elements
+  // pushed.
+  template <std::input_iterator It, std::sized_sentinel_for<It> S>
+    requires std::constructible_from<T, std::iter_reference_t<It>>
+  [[nodiscard]] std::size_t try_push_bulk(It first, S last) noexcept(
+      MPMC_NoThrow_Type<T, std::iter_reference_t<It>>)
+  {
+    auto const maxCount = static_cast<std::size_t>(last - first);
+    auto head           = head_.load(std::memory_order_relaxed);
+    while (true)
+    {
+      if (head >= CLOSED_BIT)
+      {
+        record_try_push(false);
+        return 0;
+      }
+      std::size_t count {};
+      while (count < maxCount &&
+             turn_distance(slot_at(head + count), turn(head + count) * 2) == 0)
+      {
+        ++count;
+      }
+      if (count == 0)
+      {
+        if (maxCount == 0 || turn_distance(slot_at(head), turn(head) * 2) < 0)
+        {
+          record_try_push(false);
+          return 0;
+        }
+        head = head_.load(std::memory_order_relaxed);
+      }
+      else if (compare_exchange_head(head, head + count))
+      {
+        auto* next = &slot_at(head);
+        for (std::size_t i {}; i < count; ++i, ++first)
+        {
+          auto& slot = *next;
+          if (i + 1 < count)
+          {
+            next = &slot_at(head + i + 1);
+            prefetch_slot<true>(*next);
+          }
+          write_slot(slot, *first);
+          store_turn(slot, turn(head + i) * 2 + 1);
+        }
+        record_occupancy(head + count);
+        record_try_push(true);
+        return count;
+      }
+    }
+  }
+
+  // Returns the number of elements popped, less than count only once the
+  // queue is closed and drained
+  template <std::output_iterator<T> It>
+  std::size_t pop_bulk(It out, std::size_t count) noexcept
+  {
+    auto const tail = fetch_add_tail(count);
+    std::size_t popped {};
+    auto* next = count ? &slot_at(tail) : nullptr;
+    for (std::size_t i {}; i < count; ++i)
+    {
+      auto& slot = *next;
+      if (i + 1 < count)
+      {
+        next = &slot_at(tail + i + 1);
+        prefetch_slot<false>(*next);
+      }
+      consumer_wait(slot, turn(tail + i) * 2 + 1);
+      if (tail + i >= closed_head())
+      {
+        pass_closed(slot, tail + i);
+        continue;
+      }
+      *out = slot.return_value();
+      ++out;
+      ++popped;
+      store_turn(slot, turn(tail + i) * 2 + 2);
+    }
+    return popped;
+  }
+
+  // Returns the number of elements popped, at most maxCount
+  template <std::output_iterator<T> It>
+  [[nodiscard]] std::size_t try_pop_bulk(It out, std::size_t maxCount) noexcept
+  {
+    auto tail = tail_.load(std::memory_order_relaxed);
+    while (true)
+    {
+      std::size_t count {};
+      while (count < maxCount &&
+             turn_distance(slot_at(tail + count), turn(tail + count) * 2 + 1) ==
+                 0)
+      {
+        ++count;
+      }
+      // Read after the turns, the closed marker is never popped
+      auto const closedHead = closed_head();
+      if (tail + count > closedHead)
+      {
+        count = tail < closedHead ? closedHead - tail : 0;
+        if (count == 0)
+        {
+          record_try_pop(false);
+          return 0;
+        }
+      }
+      if (count == 0)
+      {
+        if (maxCount == 0 ||
+            turn_distance(slot_at(tail), turn(tail) * 2 + 1) < 0)
+        {
+          record_try_pop(false);
+          return 0;
+        }
+        tail = tail_.load(std::memory_order_relaxed);
+      }
+      else if (compare_exchange_tail(tail, tail + count))
+      {
+        auto* next = &slot_at(tail);
+        for (std::size_t i {}; i < count; ++i, ++out)
+        {
+          auto& slot = *next;
+          if (i + 1 < count)
+          {
+            next = &slot_at(tail + i + 1);
+            prefetch_slot<false>(*next);
+          }
+          *out = slot.return_value();
+          store_turn(slot, turn(tail + i) * 2 + 2);
+        }
+        record_try_pop(true);
+        return count;
+      }
+    }
+  }
+
+  template <typename Clock, typename Duration, typename... Args>
+    requires std::constructible_from<T, Args...>
+  [[nodiscard]] bool
+  try_emplace_until(const std::chrono::time_point<Clock, Duration>& deadline,
+                    Args&&... args)
+  {
+    // try_emplace only forwards the arguments on success, gives up early once
+    // the queue is closed
+    auto pushed = false;
+    static_cast<void>(retry_until(deadline, [&] {
+      pushed = try_emplace(std::forward<Args>(args)...);
+      return pushed || closed();
+    }));
+    return pushed;
+  }
+
+  template <typename Rep, typename Period, typename... Args>
+    requires std::constructible_from<T, Args...>
+  [[nodiscard]] bool
+  try_emplace_for(const std::chrono::duration<Rep, Period>& timeout,
+                  Args&&... args)
+  {
+    return try_emplace_until(std::chrono::steady_clock::now() + timeout,
+                             std::forward<Args>(args)...);
+  }
+
+  template <typename P, typename Clock, typename Duration>
+    requires std::constructible_from<T, P&&>
+  [[nodiscard]] bool
+  try_push_until(P&& val,
+                 const std::chrono::time_point<Clock, Duration>& deadline)
+  {
+    return try_emplace_until(deadline, std::forward<P>(val));
+  }
+
+  template <typename P, typename Rep, typename Period>
+    requires std::constructible_from<T, P&&>
+  [[nodiscard]] bool
+  try_push_for(P&& val, const std::chrono::duration<Rep, Period>& timeout)
+  {
+    return try_emplace_for(timeout, std::forward<P>(val));
+  }
+
+  template <typename Clock, typename Duration>
+  [[nodiscard]] bool
+  try_pop_until(T& val,
+                const std::chrono::time_point<Clock, Duration>& deadline)
+  {
+    // Gives up early once the queue is closed and drained
+    auto popped = false;
+    static_cast<void>(retry_until(deadline, [&] {
+      popped = try_pop(val);
+      return popped || drained();
+    }));
+    return popped;
+  }
+
+  template <typename Rep, typename Period>
+  [[nodiscard]] bool
+  try_pop_for(T& val, const std::chrono::duration<Rep, Period>& timeout)
+  {
+    return try_pop_until(val, std::chrono::steady_clock::now() + timeout);
+  }
+
+  // Claims the next slot for writing in place, the slot holds the value left
+  // by the previous lap. Returns an empty handle once the queue is closed.
+  [[nodiscard]] producer_handle reserve() noexcept
+  {
+    auto const head = fetch_add_head(1);
+    if (head >= CLOSED_BIT)
+    {
+      return {};
+    }
+    auto& slot = slot_at(head);
+    prefetch_ahead<true>(head);
+    record_occupancy(head + 1);
+    producer_wait(slot, turn(head) * 2);
+    return producer_handle(&slot, turn(head) * 2 + 1);
+  }
+
+  [[nodiscard]] std::optional<producer_handle> try_reserve() noexcept
+  {
+    auto head = head_.load(std::memory_order_relaxed);
+    while (true)
+    {
+      if (head >= CLOSED_BIT)
+      {
+        record_try_push(false);
+        return std::nullopt;
+      }
+      auto& slot          = slot_at(head);
+      auto const distance = turn_distance(slot, turn(head) * 2);
+      if (distance == 0)
+      {
+        if (compare_exchange_head(head, head + 1))
+        {
+          prefetch_ahead<true>(head);
+          record_occupancy(head + 1);
+          record_try_push(true);
+          return producer_handle(&slot, turn(head) * 2 + 1);
+        }
+      }
+      else if (distance < 0)
+      {
+        record_try_push(false);
+        return std::nullopt;
+      }
+      else
+      {
+        head = head_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Publishes the slot to the consumers
+  void commit(producer_handle handle) noexcept
+  {
+    store_turn(*handle.slot_, handle.turn_);
+  }
+
+  // Claims the next slot for reading in place. Returns an empty handle once
+  // the queue is closed and drained.
+  [[nodiscard]] consumer_handle acquire() noexcept
+  {
+    auto const tail = fetch_add_tail(1);
+    auto& slot      = slot_at(tail);
+    prefetch_ahead<false>(tail);
+    consumer_wait(slot, turn(tail) * 2 + 1);
+    if (tail >= closed_head())
+    {
+      pass_closed(slot, tail);
+      return {};
+    }
+    return consumer_handle(&slot, turn(tail) * 2 + 2);
+  }
+
+  [[nodiscard]] std::optional<consumer_handle> try_acquire() noexcept
+  {
+    auto tail = tail_.load(std::memory_order_relaxed);
+    while (true)
+    {
+      auto& slot          = slot_at(tail);
+      auto const distance = turn_distance(slot, turn(tail) * 2 + 1);
+      if (distance == 0)
+      {
+        // The closed marker is left for the blocking consumers
+        if (tail >= closed_head())
+        {
+          record_try_pop(false);
+          return std::nullopt;
+        }
+        if (compare_exchange_tail(tail, tail + 1))
+        {
+          prefetch_ahead<false>(tail);
+          record_try_pop(true);
+          return consumer_handle(&slot, turn(tail) * 2 + 2);
+        }
+      }
+      else if (distance < 0)
+      {
+        record_try_pop(false);
+        return std::nullopt;
+      }
+      else
+      {
+        tail = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Returns the slot to the producers
+  void release(consumer_handle handle) noexcept
+  {
+    store_turn(*handle.slot_, handle.turn_);
+  }
+
+  // Returns false once the queue is closed and drained
+  bool pop(T& val) noexcept
   {
-    auto const tail = tail_.fetch_add(1, std::memory_order_relaxed);
-    auto& slot      = buffer_[tail % capacity_];
-    while (turn(tail) * 2 + 1 != slot.turn.load(std::memory_order_acquire)) {}
+    auto const tail = fetch_add_tail(1);
+    auto& slot      = slot_at(tail);
+    prefetch_ahead<false>(tail);
+    consumer_wait(slot, turn(tail) * 2 + 1);
+    if (tail >= closed_head())
+    {
+      pass_closed(slot, tail);
+      return false;
+    }
     val = slot.return_value();
-    slot.turn.store(turn(tail) * 2 + 2, std::memory_order_release);
+    store_turn(slot, turn(tail) * 2 + 2);
+    return true;
   }
 
   [[nodiscard]] bool try_pop(T& val) noexcept
   {
-    auto tail = tail_.load(std::memory_order_acquire);
+    auto tail = tail_.load(std::memory_order_relaxed);
     while (true)
     {
-      auto& slot = buffer_[tail % capacity_];
-      if (turn(tail) * 2 + 1 == slot.turn.load(std::memory_order_acquire))
+      auto& slot          = slot_at(tail);
+      auto const distance = turn_distance(slot, turn(tail) * 2 + 1);
+      if (distance == 0)
       {
-        if (tail_.compare_exchange_strong(tail, tail + 1))
+        // The closed marker is left for the blocking consumers
+        if (tail >= closed_head())
         {
+          record_try_pop(false);
+          return false;
+        }
+        if (compare_exchange_tail(tail, tail + 1))
+        {
+          prefetch_ahead<false>(tail);
           val = slot.return_value();
-          slot.turn.store(turn(tail) * 2 + 2, std::memory_order_release);
+          store_turn(slot, turn(tail) * 2 + 2);
+          record_try_pop(true);
           return true;
         }
       }
+      else if (distance < 0)
+      {
+        record_try_pop(false);
+        return false;
+      }
       else
       {
-        auto const prevTail = tail;
-        tail                = tail_.load(std::memory_order_acquire);
-        if (tail == prevTail)
-        {
-          return false;
-        }
+        tail = tail_.load(std::memory_order_relaxed);
       }
     }
   }
 
-  // This is an approximate size, and assumes the head and tail are less than
-  // 1/4 of std::size_t apart
+  // Claimed push tickets minus claimed pop tickets, negative while consumers
+  // wait in pop(). Wrap safe, the head and tail are read independently.
   [[nodiscard]] std::ptrdiff_t size() const noexcept
   {
-    // This needs to be a signed type, and causes a narrowing of size_t
-    auto tail = tail_.load(std::memory_order_acquire) % MAX_PTRDIFF_T;
-    auto head = head_.load(std::memory_order_acquire) % MAX_PTRDIFF_T;
-    std::ptrdiff_t headToTail = head - tail;
-    if (std::abs(headToTail) < MAX_PTRDIFF_T / 2)
+    auto const tail = tail_.load(std::memory_order_acquire);
+    auto const head = head_.load(std::memory_order_acquire);
+    return static_cast<std::ptrdiff_t>(open_head(head) - tail);
+  }
+
+  // Occupancy clamped to [0, capacity]. The tail is read before and after the
+  // head, when both agree the head and tail held those values at the same
+  // time. Falls back to the last reads after MAX_OCCUPANCY_READS attempts.
+  [[nodiscard]] std::size_t occupancy() const noexcept
+  {
+    auto tail = tail_.load(std::memory_order_acquire);
+    std::size_t head {};
+    for (std::size_t i {}; i < MAX_OCCUPANCY_READS; ++i)
     {
-      return headToTail;
+      head            = head_.load(std::memory_order_acquire);
+      auto const next = tail_.load(std::memory_order_acquire);
+      if (next == tail)
+      {
+        break;
+      }
+      tail = next;
     }
-    auto maxToTail = MAX_PTRDIFF_T - tail;
-    auto maxToHead = MAX_PTRDIFF_T - head;
-    // Handles wrap around case
-    return (maxToTail < maxToHead) ? maxToTail + head : -(maxToHead + tail);
+    return clamp_occupancy(head, tail);
+  }
+
+  // Approximate occupancy, one load that does not touch the head or tail
+  [[nodiscard]] std::size_t occupancy_hint() const noexcept
+    requires(occupancy_type::interval != 0)
+  {
+    return occupancy_.load();
+  }
+
+  [[nodiscard]] bool empty() const noexcept { return occupancy() == 0; }
+
+  // Pushes fail once closed. Pops return the elements pushed before, then
+  // fail. close() claims one ticket for the closed marker and waits for its
+  // slot like push(). The marker releases the consumers blocked in pop() one
+  // after another. With SingleProducer only the producer may call close().
+  void close() noexcept
+  {
+    auto head = head_.load(std::memory_order_relaxed);
+    do
+    {
+      if (head >= CLOSED_BIT)
+      {
+        return;
+      }
+    } while (! head_.compare_exchange_weak(head, (head + 1) | CLOSED_BIT,
+                                           std::memory_order_relaxed,
+                                           std::memory_order_relaxed));
+    closedHead_.store(head, std::memory_order_relaxed);
+    auto& slot = slot_at(head);
+    producer_wait(slot, turn(head) * 2);
+    // Publishes closedHead_ with the marker
+    store_turn(slot, turn(head) * 2 + 1);
+  }
+
+  [[nodiscard]] bool closed() const noexcept
+  {
+    return head_.load(std::memory_order_relaxed) >= CLOSED_BIT;
+  }
+
+  // Closed and every element before the closed marker is claimed by a pop
+  [[nodiscard]] bool drained() const noexcept
+  {
+    return tail_.load(std::memory_order_relaxed) >= closed_head();
+  }
+
+  [[nodiscard]] bool full() const noexcept
+  {
+    return occupancy() == capacity_;
+  }
+
+  // Whether the slot of the next pop holds a published element. Unlike
+  // empty(), a ticket claimed by a producer that has not published its slot
+  // yet does not count. Also true once other consumers moved the tail on.
+  [[nodiscard]] bool front_ready() const noexcept
+  {
+    auto const tail = tail_.load(std::memory_order_relaxed);
+    return tail < closed_head() &&
+           turn_distance(slot_at(tail), turn(tail) * 2 + 1) >= 0;
   }
 
-  [[nodiscard]] bool empty() const noexcept { return size() <= 0; }
+  // Whether the slot of the next push is free, the counterpart of
+  // front_ready() for full()
+  [[nodiscard]] bool back_ready() const noexcept
+  {
+    auto const head = head_.load(std::memory_order_relaxed);
+    return head < CLOSED_BIT &&
+           turn_distance(slot_at(head), turn(head) * 2) >= 0;
+  }
 
   [[nodiscard]] std::size_t capacity() const noexcept { return capacity_; }
+
+  // Writes a byte of every page of the slot buffer with its own value, so no
+  // operation takes the first touch page fault. Only call it before other
+  // threads use the queue.
+  void prefault() noexcept
+  {
+    auto* const bytes = reinterpret_cast<volatile unsigned char*>(buffer_);
+    auto const size   = capacity_ * sizeof(slot_type);
+    for (std::size_t i {}; i < size; i += PREFAULT_STRIDE)
+    {
+      bytes[i] = bytes[i];
+    }
+    bytes[size - 1] = bytes[size - 1];
+  }
+
+  // Sums the counters of every shard, all zero without a stats policy. The
+  // counters are read relaxed while other threads update them.
+  [[nodiscard]] MPMC_Stats stats() const noexcept { return stats_.snapshot(); }
 };
 }// namespace dro
 #endif
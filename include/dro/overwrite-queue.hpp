@@ -0,0 +1,190 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// Lossy "latest value wins" multi producer multi consumer ring for telemetry
+// and snapshot channels. A push never waits for the consumers, when the ring
+// is full it overwrites the oldest unconsumed element.
+//
+// 1) As in dro::MPMC_Queue producers claim tickets from the head and
+//    consumers from the tail.
+// 2) The turn of each slot is a seqlock version, 2 * ticket + 1 while the
+//    ticket is written and 2 * ticket + 2 once written. A producer claims the
+//    slot by raising the version, so it only waits for an older producer that
+//    is still copying into the same slot, never for a consumer. A producer
+//    that finds a newer version drops its element.
+// 3) A consumer copies the slot and rechecks the version before it claims the
+//    ticket, a torn or overwritten read is discarded. A consumer that finds
+//    its ticket overwritten moves the tail to the oldest intact ticket and
+//    adds the gap to dropped().
+//
+// T must be trivially copyable, the copy of a slot can race with its
+// overwrite and the recheck of the version discards it.
+
+#ifndef DRO_OVERWRITE_QUEUE
+#define DRO_OVERWRITE_QUEUE
+
+#include "dro/mpmc-queue.hpp"
+
+#include <algorithm>  // for min
+#include <atomic>     // for atomic, atomic_thread_fence, memory_order
+#include <cstddef>    // for size_t
+#include <memory>     // for unique_ptr, make_unique
+#include <stdexcept>  // for logic_error
+#include <type_traits>// for is_trivially_copyable_v
+#include <utility>    // for forward
+
+namespace dro
+{
+
+namespace details
+{
+template <typename T> struct alignas(cacheLineSize) overwrite_slot
+{
+  T data_ {};
+  std::atomic<std::size_t> version_ {0};
+};
+}// namespace details
+
+template <MPMC_Type T>
+  requires std::is_trivially_copyable_v<T>
+class MPMC_OverwriteQueue
+{
+public:
+  using value_type = T;
+
+private:
+  using slot_type = details::overwrite_slot<T>;
+
+  std::size_t capacity_;
+  std::unique_ptr<slot_type[]> slots_;
+  alignas(cacheLineSize) std::atomic<std::size_t> head_ {0};
+  alignas(cacheLineSize) std::atomic<std::size_t> tail_ {0};
+  alignas(cacheLineSize) std::atomic<std::size_t> dropped_ {0};
+
+  [[nodiscard]] slot_type& slot_at(std::size_t ticket) noexcept
+  {
+    return slots_[ticket % capacity_];
+  }
+
+public:
+  explicit MPMC_OverwriteQueue(const std::size_t capacity)
+      : capacity_(capacity)
+  {
+    if (capacity_ < 1)
+    {
+      throw std::logic_error("Capacity must be positive");
+    }
+    slots_ = std::make_unique<slot_type[]>(capacity_);
+  }
+
+  // non-copyable and non-movable
+  MPMC_OverwriteQueue(const MPMC_OverwriteQueue& lhs)        = delete;
+  MPMC_OverwriteQueue(MPMC_OverwriteQueue&& lhs)             = delete;
+  MPMC_OverwriteQueue& operator=(const MPMC_OverwriteQueue&) = delete;
+  MPMC_OverwriteQueue& operator=(MPMC_OverwriteQueue&&)      = delete;
+
+  // Never waits for a consumer, overwrites the oldest element when full
+  template <typename... Args>
+  void emplace(Args&&... args) noexcept(MPMC_NoThrow_Type<T, Args...>)
+    requires std::is_constructible_v<T, Args&&...>
+  {
+    auto const ticket  = head_.fetch_add(1, std::memory_order_relaxed);
+    auto& slot         = slot_at(ticket);
+    auto const writing = 2 * ticket + 1;
+    auto version       = slot.version_.load(std::memory_order_relaxed);
+    while (true)
+    {
+      if (version >= writing)
+      {
+        // A newer ticket already owns the slot, the consumers count the drop
+        return;
+      }
+      if (version & 1)
+      {
+        // An older producer is still copying into the slot
+        details::cpu_relax();
+        version = slot.version_.load(std::memory_order_relaxed);
+      }
+      // Acquire orders the write after the previous write of the slot
+      else if (slot.version_.compare_exchange_weak(version, writing,
+                                                   std::memory_order_acquire,
+                                                   std::memory_order_relaxed))
+      {
+        break;
+      }
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.data_ = T(std::forward<Args>(args)...);
+    slot.version_.store(writing + 1, std::memory_order_release);
+  }
+
+  void push(const T& val) noexcept(MPMC_NoThrow_Type<T>) { emplace(val); }
+
+  [[nodiscard]] bool try_pop(T& val) noexcept(MPMC_NoThrow_Type<T>)
+  {
+    auto ticket = tail_.load(std::memory_order_relaxed);
+    while (true)
+    {
+      auto& slot           = slot_at(ticket);
+      auto const version   = slot.version_.load(std::memory_order_acquire);
+      auto const published = 2 * ticket + 2;
+      if (version < published)
+      {
+        return false;
+      }
+      if (version == published)
+      {
+        T copy = slot.data_;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.version_.load(std::memory_order_relaxed) == version)
+        {
+          if (tail_.compare_exchange_weak(ticket, ticket + 1,
+                                          std::memory_order_relaxed))
+          {
+            val = copy;
+            return true;
+          }
+          continue;
+        }
+      }
+      // Overwritten, the version names the ticket that owns the slot now. It
+      // is at least a lap ahead and the capacity - 1 tickets before it are the
+      // oldest that can survive. The relaxed head is not ordered with the
+      // version, so it is not used here.
+      auto const owner =
+          (slot.version_.load(std::memory_order_relaxed) - 1) / 2;
+      auto const next =
+          owner >= ticket + capacity_ ? owner + 1 - capacity_ : ticket + 1;
+      if (tail_.compare_exchange_weak(ticket, next,
+                                      std::memory_order_relaxed))
+      {
+        dropped_.fetch_add(next - ticket, std::memory_order_relaxed);
+        ticket = next;
+      }
+    }
+  }
+
+  void pop(T& val) noexcept(MPMC_NoThrow_Type<T>)
+  {
+    while (! try_pop(val)) { details::cpu_relax(); }
+  }
+
+  // Elements overwritten before a consumer read them
+  [[nodiscard]] std::size_t dropped() const noexcept
+  {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+  // Claimed tickets that are not consumed yet, at most the capacity
+  [[nodiscard]] std::size_t size() const noexcept
+  {
+    auto const tail = tail_.load(std::memory_order_relaxed);
+    auto const head = head_.load(std::memory_order_relaxed);
+    return head > tail ? std::min(head - tail, capacity_) : 0;
+  }
+
+  [[nodiscard]] bool empty() const noexcept { return size() == 0; }
+
+  [[nodiscard]] std::size_t capacity() const noexcept { return capacity_; }
+};
+}// namespace dro
+#endif
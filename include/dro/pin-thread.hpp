@@ -0,0 +1,49 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// Pins a thread to a single cpu. A negative cpu leaves the affinity unchanged.
+
+#ifndef DRO_PIN_THREAD
+#define DRO_PIN_THREAD
+
+#include <pthread.h>   // for pthread_setaffinity_np, pthread_self
+#include <sched.h>     // for cpu_set_t, CPU_ZERO, CPU_SET
+#include <system_error>// for system_error
+#include <thread>      // for thread
+
+namespace dro
+{
+
+namespace details
+{
+inline void pin_native_thread(pthread_t thread, int cpu)
+{
+  if (cpu < 0)
+  {
+    return;
+  }
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  CPU_SET(cpu, &cpu_set);
+  // Returns the error number instead of setting errno
+  auto const error =
+      pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpu_set);
+  if (error != 0)
+  {
+    throw std::system_error(error, std::generic_category(),
+                            "pthread_setaffinity_np");
+  }
+}
+}// namespace details
+
+// Pins the calling thread
+inline void pinThread(int cpu)
+{
+  details::pin_native_thread(pthread_self(), cpu);
+}
+
+inline void pinThread(std::thread& thread, int cpu)
+{
+  details::pin_native_thread(thread.native_handle(), cpu);
+}
+}// namespace dro
+#endif
@@ -0,0 +1,402 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// Multi stage pipeline of pinned threads linked by dro::MPMC_Queue.
+//
+//   auto pipeline = dro::Pipeline<Raw>::builder(capacity)
+//                       .stage(1, decode)
+//                       .stage(2, normalize)
+//                       .sink(3, send);
+//   pipeline.push(raw);
+//
+// 1) Each stage runs on its own thread pinned to the given cpu, a negative
+//    cpu leaves the thread unpinned. A stage is a callable from the element
+//    of the previous stage to the element of the next one, the sink returns
+//    void.
+// 2) The input queue takes any number of producers. Every queue between two
+//    stages has exactly one producer and one consumer and uses the
+//    SingleProducer and SingleConsumer policies.
+// 3) A stage pops up to Batch elements with one try_pop_bulk(), runs them and
+//    hands the results to the next stage with one push_bulk().
+// 4) stop() closes the input and drains it, every element pushed before
+//    stop() passes through every stage before the threads exit. The
+//    destructor calls stop(). Elements must not be pushed after stop().
+// 5) Stages must not throw, an exception escaping a stage calls
+//    std::terminate.
+
+#ifndef DRO_PIPELINE
+#define DRO_PIPELINE
+
+#include "dro/mpmc-queue.hpp"
+#include "dro/pin-thread.hpp"
+
+#include <array>      // for array
+#include <atomic>     // for atomic, memory_order
+#include <concepts>   // for invocable
+#include <cstddef>    // for size_t, ptrdiff_t
+#include <functional> // for invoke
+#include <iterator>   // for make_move_iterator
+#include <memory>     // for allocator, unique_ptr, make_unique
+#include <stdexcept>  // for logic_error
+#include <thread>     // for thread, yield
+#include <type_traits>// for invoke_result_t, is_void_v, conditional_t
+#include <utility>    // for forward, move
+#include <vector>     // for vector
+
+namespace dro
+{
+
+struct PipelineStageStats
+{
+  // Elements the stage has finished, sample twice for the throughput
+  std::size_t processed;
+  // Hand offs, processed / batches is the mean batch size
+  std::size_t batches;
+  // Elements waiting in the input queue of the stage
+  std::ptrdiff_t depth;
+};
+
+namespace details
+{
+// A queue and the flag its producer raises once it has pushed its last
+// element. Links are heap allocated so stages can refer to each other. A
+// push into a full link yields like an idle stage.
+template <MPMC_Type T, MPMC_Policy Producer> struct pipeline_link
+{
+  using value_type = T;
+
+  explicit pipeline_link(std::size_t capacity) : queue_(capacity) {}
+
+  MPMC_Queue<T, std::allocator<Slot<T>>, Producer, SingleConsumer,
+             YieldWait<>>
+      queue_;
+  alignas(cacheLineSize) std::atomic<bool> done_ {false};
+};
+
+class pipeline_stage_base
+{
+public:
+  explicit pipeline_stage_base(int cpu) noexcept : cpu_(cpu) {}
+  virtual ~pipeline_stage_base() = default;
+
+  virtual void run() noexcept = 0;
+  [[nodiscard]] virtual std::ptrdiff_t depth() const noexcept = 0;
+
+  [[nodiscard]] PipelineStageStats stats() const noexcept
+  {
+    return {processed_.load(std::memory_order_relaxed),
+            batches_.load(std::memory_order_relaxed), depth()};
+  }
+
+  int const cpu_;
+
+protected:
+  // Only written by the stage thread
+  alignas(cacheLineSize) std::atomic<std::size_t> processed_ {0};
+  std::atomic<std::size_t> batches_ {0};
+
+  void record_batch(std::size_t count) noexcept
+  {
+    processed_.store(processed_.load(std::memory_order_relaxed) + count,
+                     std::memory_order_relaxed);
+    batches_.store(batches_.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_relaxed);
+  }
+
+  // Spins and then yields the thread to the scheduler, as YieldWait
+  static void idle(std::size_t& misses) noexcept
+  {
+    if (misses++ < 128)
+    {
+      details::cpu_relax();
+    }
+    else
+    {
+      std::this_thread::yield();
+    }
+  }
+};
+
+template <typename Out> struct pipeline_output
+{
+  using type = pipeline_link<Out, SingleProducer>;
+};
+
+// The sink has no output
+template <> struct pipeline_output<void>
+{
+  struct type
+  {
+    explicit type(std::size_t) noexcept {}
+  };
+};
+
+template <typename InLink, typename F, std::size_t Batch>
+class pipeline_stage final : public pipeline_stage_base
+{
+public:
+  using in_type     = typename InLink::value_type;
+  using out_type    = std::invoke_result_t<F&, in_type&&>;
+  using output_type = typename pipeline_output<out_type>::type;
+
+private:
+  InLink& input_;
+  F f_;
+  output_type output_;
+
+public:
+  template <typename G>
+  pipeline_stage(int cpu, InLink& input, G&& f, std::size_t capacity)
+      : pipeline_stage_base(cpu), input_(input), f_(std::forward<G>(f)),
+        output_(capacity)
+  {
+  }
+
+  [[nodiscard]] output_type& output() noexcept { return output_; }
+
+  [[nodiscard]] std::ptrdiff_t depth() const noexcept override
+  {
+    return input_.queue_.size();
+  }
+
+  void run() noexcept override
+  {
+    std::array<in_type, Batch> in;
+    // Unused by the sink
+    [[maybe_unused]] std::conditional_t<std::is_void_v<out_type>, bool,
+                                        std::array<out_type, Batch>>
+        out;
+    std::size_t misses {};
+    while (true)
+    {
+      // Read before the pop, once set an empty input stays empty
+      auto const closed = input_.done_.load(std::memory_order_acquire);
+      auto const count  = input_.queue_.try_pop_bulk(in.begin(), Batch);
+      if (count == 0)
+      {
+        if (closed)
+        {
+          break;
+        }
+        idle(misses);
+        continue;
+      }
+      misses = 0;
+      for (std::size_t i {}; i < count; ++i)
+      {
+        if constexpr (std::is_void_v<out_type>)
+        {
+          std::invoke(f_, std::move(in[i]));
+        }
+        else
+        {
+          out[i] = std::invoke(f_, std::move(in[i]));
+        }
+      }
+      if constexpr (! std::is_void_v<out_type>)
+      {
+        output_.queue_.push_bulk(
+            std::make_move_iterator(out.begin()),
+            std::make_move_iterator(out.begin() + count));
+      }
+      record_batch(count);
+    }
+    if constexpr (! std::is_void_v<out_type>)
+    {
+      output_.done_.store(true, std::memory_order_release);
+    }
+  }
+};
+}// namespace details
+
+template <MPMC_Type In, std::size_t Batch> class Pipeline;
+
+// Returned by Pipeline::builder(), every stage() returns a new builder whose
+// tail is the output of that stage
+template <MPMC_Type In, typename TailLink, std::size_t Batch>
+class PipelineBuilder
+{
+private:
+  using source_type = details::pipeline_link<In, MultiProducer>;
+
+  template <MPMC_Type, typename, std::size_t> friend class PipelineBuilder;
+  friend class Pipeline<In, Batch>;
+
+  std::size_t capacity_;
+  std::unique_ptr<source_type> source_;
+  std::vector<std::unique_ptr<details::pipeline_stage_base>> stages_;
+  TailLink* tail_;
+
+  PipelineBuilder(
+      std::size_t capacity, std::unique_ptr<source_type> source,
+      std::vector<std::unique_ptr<details::pipeline_stage_base>> stages,
+      TailLink* tail) noexcept
+      : capacity_(capacity), source_(std::move(source)),
+        stages_(std::move(stages)), tail_(tail)
+  {
+  }
+
+  template <typename F>
+  using result_t = std::invoke_result_t<std::decay_t<F>&,
+                                        typename TailLink::value_type&&>;
+
+  // Returns the output link of the new stage
+  template <typename F> auto append(int cpu, F&& f)
+  {
+    using stage_type =
+        details::pipeline_stage<TailLink, std::decay_t<F>, Batch>;
+    auto stage = std::make_unique<stage_type>(cpu, *tail_, std::forward<F>(f),
+                                              capacity_);
+    auto& output = stage->output();
+    stages_.push_back(std::move(stage));
+    return &output;
+  }
+
+public:
+  using value_type = typename TailLink::value_type;
+
+  // Adds a stage from value_type to the element type F returns
+  template <typename F>
+    requires std::invocable<std::decay_t<F>&, value_type&&> &&
+             MPMC_Type<result_t<F>>
+  [[nodiscard]] auto stage(int cpu, F&& f) &&
+  {
+    auto* tail = append(cpu, std::forward<F>(f));
+    return PipelineBuilder<In, std::remove_pointer_t<decltype(tail)>, Batch>(
+        capacity_, std::move(source_), std::move(stages_), tail);
+  }
+
+  // Adds the last stage and starts the threads
+  template <typename F>
+    requires std::invocable<std::decay_t<F>&, value_type&&> &&
+             std::is_void_v<result_t<F>>
+  [[nodiscard]] Pipeline<In, Batch> sink(int cpu, F&& f) &&
+  {
+    append(cpu, std::forward<F>(f));
+    return Pipeline<In, Batch>(std::move(source_), std::move(stages_));
+  }
+};
+
+template <MPMC_Type In, std::size_t Batch = 32> class Pipeline
+{
+public:
+  using value_type = In;
+
+private:
+  using source_type = details::pipeline_link<In, MultiProducer>;
+
+  template <MPMC_Type, typename, std::size_t> friend class PipelineBuilder;
+
+  std::unique_ptr<source_type> source_;
+  std::vector<std::unique_ptr<details::pipeline_stage_base>> stages_;
+  std::vector<std::thread> threads_;
+
+  Pipeline(std::unique_ptr<source_type> source,
+           std::vector<std::unique_ptr<details::pipeline_stage_base>> stages)
+      : source_(std::move(source)), stages_(std::move(stages))
+  {
+    try
+    {
+      threads_.reserve(stages_.size());
+      for (auto& stage : stages_)
+      {
+        threads_.emplace_back([s = stage.get()] { s->run(); });
+        pinThread(threads_.back(), stage->cpu_);
+      }
+    }
+    catch (...)
+    {
+      stop();
+      throw;
+    }
+  }
+
+public:
+  static_assert(Batch > 0, "Batch must be positive");
+
+  // capacity is per queue
+  [[nodiscard]] static PipelineBuilder<In, source_type, Batch>
+  builder(const std::size_t capacity)
+  {
+    if (capacity < 1)
+    {
+      throw std::logic_error("Capacity must be positive");
+    }
+    auto source = std::make_unique<source_type>(capacity);
+    auto* tail  = source.get();
+    return PipelineBuilder<In, source_type, Batch>(capacity, std::move(source),
+                                                   {}, tail);
+  }
+
+  Pipeline(Pipeline&& rhs) noexcept            = default;
+  Pipeline& operator=(Pipeline&& rhs) noexcept = delete;
+
+  // non-copyable
+  Pipeline(const Pipeline& lhs)            = delete;
+  Pipeline& operator=(const Pipeline& lhs) = delete;
+
+  ~Pipeline() { stop(); }
+
+  template <typename... Args>
+    requires std::constructible_from<In, Args...>
+  void emplace(Args&&... args) noexcept(MPMC_NoThrow_Type<In, Args&&...>)
+  {
+    source_->queue_.emplace(std::forward<Args>(args)...);
+  }
+
+  template <typename... Args>
+    requires std::constructible_from<In, Args...>
+  [[nodiscard]] bool
+  try_emplace(Args&&... args) noexcept(MPMC_NoThrow_Type<In, Args&&...>)
+  {
+    return source_->queue_.try_emplace(std::forward<Args>(args)...);
+  }
+
+  void push(const In& val) noexcept(MPMC_NoThrow_Type<In>) { emplace(val); }
+
+  template <typename P>
+    requires std::constructible_from<In, P&&>
+  void push(P&& val) noexcept(MPMC_NoThrow_Type<In, P&&>)
+  {
+    emplace(std::forward<P>(val));
+  }
+
+  [[nodiscard]] bool try_push(const In& val) noexcept(MPMC_NoThrow_Type<In>)
+  {
+    return try_emplace(val);
+  }
+
+  template <typename P>
+    requires std::constructible_from<In, P&&>
+  [[nodiscard]] bool try_push(P&& val) noexcept(MPMC_NoThrow_Type<In, P&&>)
+  {
+    return try_emplace(std::forward<P>(val));
+  }
+
+  // Drains every stage and joins the threads, safe to call more than once
+  void stop()
+  {
+    if (! source_)
+    {
+      return;
+    }
+    source_->done_.store(true, std::memory_order_release);
+    for (auto& thread : threads_) { thread.join(); }
+    threads_.clear();
+  }
+
+  // Indexed in stage order, the sink last
+  [[nodiscard]] std::vector<PipelineStageStats> stats() const
+  {
+    std::vector<PipelineStageStats> stats;
+    stats.reserve(stages_.size());
+    for (auto const& stage : stages_) { stats.push_back(stage->stats()); }
+    return stats;
+  }
+
+  [[nodiscard]] std::size_t stage_count() const noexcept
+  {
+    return stages_.size();
+  }
+};
+}// namespace dro
+#endif
@@ -0,0 +1,192 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// Priority lanes over Lanes independent dro::MPMC_Queue instances. Producers
+// push to a lane of their choice, consumers pop from the highest priority
+// non-empty lane, lane 0 is the highest priority.
+//
+// A non-empty bitmask on its own cache line lets consumers skip empty lanes
+// instead of probing every lane with a failing try_pop.
+// 1) Producers set the bit of a lane after a push, only when they see it
+//    clear, so a busy lane costs one load and no read modify write.
+// 2) A consumer that finds a lane empty clears its bit and checks the lane
+//    once more. The asymmetric fences make sure that either the producer
+//    sees the cleared bit and sets it again, or the consumer sees the element.
+//    A push only pays a compiler barrier, the membarrier of the heavy fence is
+//    paid once per cleared bit, see asymmetric-fence.hpp.
+//
+// Elements of one lane keep the ordering of dro::MPMC_Queue, there is no
+// ordering between lanes.
+
+#ifndef DRO_PRIORITY_QUEUE
+#define DRO_PRIORITY_QUEUE
+
+#include "dro/asymmetric-fence.hpp"
+#include "dro/mpmc-queue.hpp"
+
+#include <atomic>   // for atomic, memory_order
+#include <bit>      // for countr_zero
+#include <cstddef>  // for size_t, ptrdiff_t
+#include <cstdint>  // for uint64_t
+#include <memory>   // for allocator, unique_ptr
+#include <utility>  // for forward
+#include <vector>   // for vector
+
+namespace dro
+{
+
+template <MPMC_Type T, std::size_t Lanes,
+          typename Allocator = std::allocator<Slot<T>>,
+          MPMC_Policy... Policies>
+  requires(Lanes > 0 && Lanes <= 64)
+class MPMC_PriorityQueue
+{
+public:
+  using queue_type = MPMC_Queue<T, Allocator, Policies...>;
+  using value_type = T;
+
+private:
+  std::vector<std::unique_ptr<queue_type>> lanes_;
+  alignas(cacheLineSize) std::atomic<std::uint64_t> nonEmpty_ {0};
+
+  void mark_non_empty(std::size_t lane) noexcept
+  {
+    auto const bit = std::uint64_t {1} << lane;
+    // Orders the push before the load, pairs with the heavy fence in try_pop
+    details::asymmetric_fence_light();
+    if (! (nonEmpty_.load(std::memory_order_relaxed) & bit))
+    {
+      nonEmpty_.fetch_or(bit, std::memory_order_release);
+    }
+  }
+
+public:
+  // capacity is per lane
+  explicit MPMC_PriorityQueue(const std::size_t capacity,
+                              const Allocator& allocator = Allocator())
+  {
+    lanes_.reserve(Lanes);
+    for (std::size_t i {}; i < Lanes; ++i)
+    {
+      lanes_.push_back(std::make_unique<queue_type>(capacity, allocator));
+    }
+    // Registers the membarrier off the push path
+    static_cast<void>(details::membarrier_available());
+  }
+
+  // non-copyable and non-movable
+  MPMC_PriorityQueue(const MPMC_PriorityQueue& lhs)        = delete;
+  MPMC_PriorityQueue(MPMC_PriorityQueue&& lhs)             = delete;
+  MPMC_PriorityQueue& operator=(const MPMC_PriorityQueue&) = delete;
+  MPMC_PriorityQueue& operator=(MPMC_PriorityQueue&&)      = delete;
+
+  ~MPMC_PriorityQueue() = default;
+
+  template <typename... Args>
+    requires std::constructible_from<T, Args...>
+  void emplace(std::size_t lane,
+               Args&&... args) noexcept(MPMC_NoThrow_Type<T, Args&&...>)
+  {
+    lanes_[lane]->emplace(std::forward<Args>(args)...);
+    mark_non_empty(lane);
+  }
+
+  template <typename... Args>
+    requires std::constructible_from<T, Args...>
+  [[nodiscard]] bool try_emplace(std::size_t lane, Args&&... args) noexcept(
+      MPMC_NoThrow_Type<T, Args&&...>)
+  {
+    if (! lanes_[lane]->try_emplace(std::forward<Args>(args)...))
+    {
+      return false;
+    }
+    mark_non_empty(lane);
+    return true;
+  }
+
+  void push(std::size_t lane, const T& val) noexcept(MPMC_NoThrow_Type<T>)
+  {
+    emplace(lane, val);
+  }
+
+  template <typename P>
+    requires std::constructible_from<T, P&&>
+  void push(std::size_t lane, P&& val) noexcept(MPMC_NoThrow_Type<T, P&&>)
+  {
+    emplace(lane, std::forward<P>(val));
+  }
+
+  [[nodiscard]] bool try_push(std::size_t lane,
+                              const T& val) noexcept(MPMC_NoThrow_Type<T>)
+  {
+    return try_emplace(lane, val);
+  }
+
+  template <typename P>
+    requires std::constructible_from<T, P&&>
+  [[nodiscard]] bool try_push(std::size_t lane,
+                              P&& val) noexcept(MPMC_NoThrow_Type<T, P&&>)
+  {
+    return try_emplace(lane, std::forward<P>(val));
+  }
+
+  // Polls the lanes until one succeeds
+  void pop(T& val) noexcept
+  {
+    while (! try_pop(val)) { details::cpu_relax(); }
+  }
+
+  // Pops from the highest priority lane with its bit set, returns false once
+  // every bit is clear
+  [[nodiscard]] bool try_pop(T& val) noexcept
+  {
+    auto mask = nonEmpty_.load(std::memory_order_acquire);
+    while (mask)
+    {
+      auto const lane = static_cast<std::size_t>(std::countr_zero(mask));
+      auto const bit  = std::uint64_t {1} << lane;
+      if (lanes_[lane]->try_pop(val))
+      {
+        return true;
+      }
+      nonEmpty_.fetch_and(~bit, std::memory_order_relaxed);
+      // Orders the clear before the recheck, pairs with the light fence in
+      // mark_non_empty()
+      details::asymmetric_fence_heavy();
+      if (lanes_[lane]->try_pop(val))
+      {
+        // The lane may hold more elements than the one popped
+        nonEmpty_.fetch_or(bit, std::memory_order_relaxed);
+        return true;
+      }
+      mask = nonEmpty_.load(std::memory_order_acquire) & ~bit;
+    }
+    return false;
+  }
+
+  // Sum of the approximate lane sizes
+  [[nodiscard]] std::ptrdiff_t size() const noexcept
+  {
+    std::ptrdiff_t total {};
+    for (auto const& lane : lanes_) { total += lane->size(); }
+    return total;
+  }
+
+  [[nodiscard]] bool empty() const noexcept { return size() <= 0; }
+
+  [[nodiscard]] std::size_t capacity() const noexcept
+  {
+    return Lanes * lanes_.front()->capacity();
+  }
+
+  [[nodiscard]] static constexpr std::size_t lane_count() noexcept
+  {
+    return Lanes;
+  }
+
+  [[nodiscard]] queue_type& lane(std::size_t index) noexcept
+  {
+    return *lanes_[index];
+  }
+};
+}// namespace dro
+#endif
@@ -0,0 +1,490 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// Unbounded MPMC queue built from a linked list of fixed size ring segments.
+// Each segment uses the ticket / turn scheme of dro::MPMC_Queue, in the
+// steady state producers and consumers wrap around the same segment and the
+// cost stays close to the bounded queue.
+//
+// 1) A producer that finds the tail segment full sets the closed bit of the
+//    segment head, links a segment from the free list and moves the tail on.
+// 2) A consumer that finds the head segment closed and drained moves the
+//    head on and retires the segment.
+// 3) Retired segments are recycled once no hazard pointer refers to them.
+//    Every thread publishes the segment it works on in a hazard pointer and
+//    keeps it between operations, so protecting the same segment again needs
+//    no fence. A thread that stops using the queue holds back at most one
+//    segment until its next operation or until it exits.
+// 4) Up to maxFreeSegments drained segments are kept for reuse, the rest are
+//    deallocated, so the memory tracks the backlog. The free list is guarded
+//    by a mutex, it is only touched when a segment fills up or drains.
+//
+// Elements pushed by one thread are popped in the order they were pushed.
+
+#ifndef DRO_SEGMENTED_QUEUE
+#define DRO_SEGMENTED_QUEUE
+
+#include "dro/mpmc-queue.hpp"
+
+#include <algorithm>  // for remove_if
+#include <atomic>     // for atomic, memory_order
+#include <bit>        // for bit_ceil, countr_zero
+#include <cstddef>    // for size_t, ptrdiff_t
+#include <limits>     // for numeric_limits
+#include <memory>     // for allocator, allocator_traits
+#include <mutex>      // for mutex, lock_guard
+#include <stdexcept>  // for logic_error
+#include <utility>    // for forward
+#include <vector>     // for vector
+
+namespace dro
+{
+
+namespace details
+{
+struct alignas(cacheLineSize) hazard_record
+{
+  std::atomic<const void*> pointer {nullptr};
+  std::atomic<bool> active {false};
+  hazard_record* next {nullptr};
+};
+
+// Records are shared by every segmented queue and never freed, a thread owns
+// one record from its first operation until it exits
+inline std::atomic<hazard_record*>& hazard_records() noexcept
+{
+  static std::atomic<hazard_record*> head {nullptr};
+  return head;
+}
+
+class hazard_owner
+{
+private:
+  hazard_record* record_ {nullptr};
+
+public:
+  hazard_owner()
+  {
+    auto& head = hazard_records();
+    for (auto* record = head.load(std::memory_order_acquire); record;
+         record       = record->next)
+    {
+      bool expected = false;
+      if (! record->active.load(std::memory_order_relaxed) &&
+          record->active.compare_exchange_strong(expected, true,
+                                                 std::memory_order_acquire))
+      {
+        record_ = record;
+        return;
+      }
+    }
+    record_ = new hazard_record;
+    record_->active.store(true, std::memory_order_relaxed);
+    auto* first = head.load(std::memory_order_relaxed);
+    do
+    {
+      record_->next = first;
+    } while (! head.compare_exchange_weak(first, record_,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed));
+  }
+
+  hazard_owner(const hazard_owner&)            = delete;
+  hazard_owner& operator=(const hazard_owner&) = delete;
+
+  ~hazard_owner()
+  {
+    record_->pointer.store(nullptr, std::memory_order_release);
+    record_->active.store(false, std::memory_order_release);
+  }
+
+  [[nodiscard]] hazard_record& record() noexcept { return *record_; }
+};
+
+[[nodiscard]] inline hazard_record& local_hazard()
+{
+  static thread_local hazard_owner owner;
+  return owner.record();
+}
+
+// Returns the pointer held by src once it is published in the hazard pointer
+// of the thread. A pointer that is already published has been protected
+// continuously since it was validated, and is returned without a fence.
+template <typename P> [[nodiscard]] P* protect(const std::atomic<P*>& src)
+{
+  auto& hazard = local_hazard().pointer;
+  auto* ptr    = src.load(std::memory_order_acquire);
+  while (hazard.load(std::memory_order_relaxed) != ptr)
+  {
+    hazard.store(ptr, std::memory_order_seq_cst);
+    ptr = src.load(std::memory_order_seq_cst);
+  }
+  return ptr;
+}
+
+[[nodiscard]] inline bool is_hazardous(const void* ptr) noexcept
+{
+  for (auto* record = hazard_records().load(std::memory_order_acquire); record;
+       record       = record->next)
+  {
+    if (record->pointer.load(std::memory_order_seq_cst) == ptr)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+}// namespace details
+
+template <MPMC_Type T, typename Allocator = std::allocator<Slot<T>>>
+class MPMC_SegmentedQueue
+{
+public:
+  using value_type     = T;
+  using slot_type      = Slot<T>;
+  using allocator_type = typename std::allocator_traits<
+      Allocator>::template rebind_alloc<slot_type>;
+
+private:
+  struct Segment
+  {
+    alignas(cacheLineSize) std::atomic<std::size_t> tail {0};
+    alignas(cacheLineSize) std::atomic<std::size_t> head {0};
+    alignas(cacheLineSize) std::atomic<Segment*> next {nullptr};
+    slot_type* slots {nullptr};
+  };
+
+  enum class PopResult
+  {
+    Success,
+    Empty,
+    Drained
+  };
+
+  static constexpr std::size_t MAX_POWER_OF_TWO =
+      (std::numeric_limits<std::size_t>::max() >> 1) + 1;
+  // Set in a segment head once the segment is full, no tickets are claimed
+  // after it
+  static constexpr std::size_t CLOSED = MAX_POWER_OF_TWO;
+
+  std::size_t capacity_;
+  std::size_t shift_;
+  std::size_t maxFreeSegments_;
+  allocator_type allocator_ [[no_unique_address]];
+
+  alignas(cacheLineSize) std::atomic<Segment*> head_ {nullptr};
+  alignas(cacheLineSize) std::atomic<Segment*> tail_ {nullptr};
+
+  alignas(cacheLineSize) std::mutex poolMutex_;
+  std::vector<Segment*> free_;
+  std::vector<Segment*> retired_;
+  std::atomic<std::size_t> segments_ {0};
+
+  [[nodiscard]] static std::ptrdiff_t
+  turn_distance(const slot_type& slot, std::size_t expected) noexcept
+  {
+    return static_cast<std::ptrdiff_t>(
+        slot.turn.load(std::memory_order_acquire) - expected);
+  }
+
+  [[nodiscard]] std::size_t turn(std::size_t ticket) const noexcept
+  {
+    return ticket >> shift_;
+  }
+
+  [[nodiscard]] slot_type& slot_at(Segment& segment,
+                                   std::size_t ticket) const noexcept
+  {
+    return segment.slots[ticket & (capacity_ - 1)];
+  }
+
+  // Returns false once the segment is closed, closing it when it is full
+  template <typename... Args>
+  [[nodiscard]] bool segment_emplace(Segment& segment, Args&&... args) noexcept(
+      MPMC_NoThrow_Type<T, Args&&...>)
+  {
+    auto head = segment.head.load(std::memory_order_relaxed);
+    while (true)
+    {
+      if (head & CLOSED)
+      {
+        return false;
+      }
+      auto& slot          = slot_at(segment, head);
+      auto const distance = turn_distance(slot, turn(head) * 2);
+      if (distance == 0)
+      {
+        if (segment.head.compare_exchange_weak(head, head + 1,
+                                               std::memory_order_relaxed,
+                                               std::memory_order_relaxed))
+        {
+          slot.assign_value(std::forward<Args>(args)...);
+          slot.turn.store(turn(head) * 2 + 1, std::memory_order_release);
+          return true;
+        }
+      }
+      else if (distance < 0)
+      {
+        if (segment.head.compare_exchange_weak(head, head | CLOSED,
+                                               std::memory_order_relaxed,
+                                               std::memory_order_relaxed))
+        {
+          return false;
+        }
+      }
+      else
+      {
+        head = segment.head.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Drained once the segment is closed and every ticket has been popped
+  [[nodiscard]] PopResult segment_pop(Segment& segment, T& val) noexcept
+  {
+    auto tail = segment.tail.load(std::memory_order_relaxed);
+    while (true)
+    {
+      auto& slot          = slot_at(segment, tail);
+      auto const distance = turn_distance(slot, turn(tail) * 2 + 1);
+      if (distance == 0)
+      {
+        if (segment.tail.compare_exchange_weak(tail, tail + 1,
+                                               std::memory_order_relaxed,
+                                               std::memory_order_relaxed))
+        {
+          val = slot.return_value();
+          slot.turn.store(turn(tail) * 2 + 2, std::memory_order_release);
+          return PopResult::Success;
+        }
+      }
+      else if (distance < 0)
+      {
+        return segment.head.load(std::memory_order_acquire) == (tail | CLOSED)
+                   ? PopResult::Drained
+                   : PopResult::Empty;
+      }
+      else
+      {
+        tail = segment.tail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  [[nodiscard]] Segment* create_segment()
+  {
+    auto* segment = new Segment;
+    try
+    {
+      segment->slots = allocator_.allocate(capacity_);
+    }
+    catch (...)
+    {
+      delete segment;
+      throw;
+    }
+    for (std::size_t i {}; i < capacity_; ++i)
+    {
+      new (&segment->slots[i]) slot_type();
+    }
+    segments_.fetch_add(1, std::memory_order_relaxed);
+    return segment;
+  }
+
+  void destroy_segment(Segment* segment) noexcept
+  {
+    for (std::size_t i {}; i < capacity_; ++i)
+    {
+      segment->slots[i].~slot_type();
+    }
+    allocator_.deallocate(segment->slots, capacity_);
+    delete segment;
+    segments_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  // Requires poolMutex_. Every slot of a drained segment holds an even turn.
+  void recycle(Segment* segment) noexcept
+  {
+    if (free_.size() >= maxFreeSegments_)
+    {
+      destroy_segment(segment);
+      return;
+    }
+    segment->head.store(0, std::memory_order_relaxed);
+    segment->tail.store(0, std::memory_order_relaxed);
+    segment->next.store(nullptr, std::memory_order_relaxed);
+    for (std::size_t i {}; i < capacity_; ++i)
+    {
+      segment->slots[i].turn.store(0, std::memory_order_relaxed);
+    }
+    free_.push_back(segment);
+  }
+
+  // Requires poolMutex_
+  void reclaim() noexcept
+  {
+    auto const last =
+        std::remove_if(retired_.begin(), retired_.end(), [&](Segment* segment) {
+          if (details::is_hazardous(segment))
+          {
+            return false;
+          }
+          recycle(segment);
+          return true;
+        });
+    retired_.erase(last, retired_.end());
+  }
+
+  [[nodiscard]] Segment* acquire_segment()
+  {
+    {
+      std::lock_guard<std::mutex> lock(poolMutex_);
+      reclaim();
+      if (! free_.empty())
+      {
+        auto* segment = free_.back();
+        free_.pop_back();
+        return segment;
+      }
+    }
+    return create_segment();
+  }
+
+  void retire(Segment* segment)
+  {
+    std::lock_guard<std::mutex> lock(poolMutex_);
+    retired_.push_back(segment);
+    reclaim();
+  }
+
+public:
+  // segmentCapacity is rounded up to a power of two
+  explicit MPMC_SegmentedQueue(const std::size_t segmentCapacity,
+                               const std::size_t maxFreeSegments = 1,
+                               const Allocator& allocator = Allocator())
+      : capacity_(segmentCapacity), maxFreeSegments_(maxFreeSegments),
+        allocator_(allocator_type(allocator))
+  {
+    if (capacity_ < 1)
+    {
+      throw std::logic_error("Capacity must be positive");
+    }
+    if (capacity_ > MAX_POWER_OF_TWO)
+    {
+      throw std::logic_error("Capacity exceeds largest power of two");
+    }
+    capacity_     = std::bit_ceil(capacity_);
+    shift_        = std::countr_zero(capacity_);
+    auto* segment = create_segment();
+    head_.store(segment, std::memory_order_relaxed);
+    tail_.store(segment, std::memory_order_relaxed);
+  }
+
+  ~MPMC_SegmentedQueue() noexcept
+  {
+    auto* segment = head_.load(std::memory_order_relaxed);
+    while (segment)
+    {
+      auto* next = segment->next.load(std::memory_order_relaxed);
+      destroy_segment(segment);
+      segment = next;
+    }
+    for (auto* free : free_) { destroy_segment(free); }
+    for (auto* retired : retired_) { destroy_segment(retired); }
+  }
+
+  // non-copyable and non-movable
+  MPMC_SegmentedQueue(const MPMC_SegmentedQueue& lhs)        = delete;
+  MPMC_SegmentedQueue(MPMC_SegmentedQueue&& lhs)             = delete;
+  MPMC_SegmentedQueue& operator=(const MPMC_SegmentedQueue&) = delete;
+  MPMC_SegmentedQueue& operator=(MPMC_SegmentedQueue&&)      = delete;
+
+  // Never waits for a consumer, links a new segment when the tail is full
+  template <typename... Args>
+    requires std::constructible_from<T, Args...>
+  void emplace(Args&&... args)
+  {
+    while (true)
+    {
+      auto* segment = details::protect(tail_);
+      if (segment_emplace(*segment, std::forward<Args>(args)...))
+      {
+        return;
+      }
+      auto* next = segment->next.load(std::memory_order_acquire);
+      if (! next)
+      {
+        auto* fresh = acquire_segment();
+        if (segment->next.compare_exchange_strong(next, fresh,
+                                                  std::memory_order_acq_rel,
+                                                  std::memory_order_acquire))
+        {
+          next = fresh;
+        }
+        else
+        {
+          std::lock_guard<std::mutex> lock(poolMutex_);
+          recycle(fresh);
+        }
+      }
+      tail_.compare_exchange_strong(segment, next, std::memory_order_release,
+                                    std::memory_order_relaxed);
+    }
+  }
+
+  void push(const T& val) { emplace(val); }
+
+  template <typename P>
+    requires std::constructible_from<T, P&&>
+  void push(P&& val)
+  {
+    emplace(std::forward<P>(val));
+  }
+
+  void pop(T& val)
+  {
+    while (! try_pop(val)) { details::cpu_relax(); }
+  }
+
+  [[nodiscard]] bool try_pop(T& val)
+  {
+    while (true)
+    {
+      auto* segment     = details::protect(head_);
+      auto const result = segment_pop(*segment, val);
+      if (result != PopResult::Drained)
+      {
+        return result == PopResult::Success;
+      }
+      auto* next = segment->next.load(std::memory_order_acquire);
+      if (! next)
+      {
+        return false;
+      }
+      // The tail never falls behind the head, so a retired segment is
+      // unreachable from both
+      auto* expected = segment;
+      tail_.compare_exchange_strong(expected, next, std::memory_order_seq_cst,
+                                    std::memory_order_relaxed);
+      expected = segment;
+      if (head_.compare_exchange_strong(expected, next,
+                                        std::memory_order_seq_cst,
+                                        std::memory_order_relaxed))
+      {
+        retire(segment);
+      }
+    }
+  }
+
+  [[nodiscard]] std::size_t segment_capacity() const noexcept
+  {
+    return capacity_;
+  }
+
+  // Segments currently allocated, linked, free or waiting for reclamation
+  [[nodiscard]] std::size_t segment_count() const noexcept
+  {
+    return segments_.load(std::memory_order_relaxed);
+  }
+};
+}// namespace dro
+#endif
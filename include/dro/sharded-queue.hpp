@@ -0,0 +1,177 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// Sharded front end over N independent dro::MPMC_Queue instances. Producers
+// and consumers are assigned home shards round robin, producers push to their
+// home shard and consumers pop from their home shard before stealing round
+// robin from the others. This spreads the head and tail contention over N
+// cache lines.
+//
+// Ordering guarantee (relaxed FIFO):
+// 1) Elements pushed by one thread with push() / emplace() go to the same
+//    shard and are popped in the order they were pushed.
+// 2) There is no ordering between elements pushed by different threads.
+// 3) try_push() / try_emplace() spill to the next shard when the home shard is
+//    full, spilled elements are not ordered against the home shard.
+
+#ifndef DRO_SHARDED_QUEUE
+#define DRO_SHARDED_QUEUE
+
+#include "dro/mpmc-queue.hpp"
+
+#include <atomic>   // for atomic, memory_order
+#include <cstddef>  // for size_t
+#include <memory>   // for allocator, unique_ptr
+#include <stdexcept>// for logic_error
+#include <utility>  // for forward
+#include <vector>   // for vector
+
+namespace dro
+{
+
+namespace details
+{
+// Home shard roles of threadToken() from mpmc-queue.hpp
+struct producer_token
+{
+};
+
+struct consumer_token
+{
+};
+}// namespace details
+
+template <MPMC_Type T, typename Allocator = std::allocator<Slot<T>>,
+          MPMC_Policy... Policies>
+class MPMC_ShardedQueue
+{
+public:
+  using queue_type = MPMC_Queue<T, Allocator, Policies...>;
+  using value_type = T;
+
+private:
+  std::vector<std::unique_ptr<queue_type>> shards_;
+
+  template <typename Role> [[nodiscard]] std::size_t home() const noexcept
+  {
+    return details::threadToken<Role>() % shards_.size();
+  }
+
+public:
+  // capacity is per shard
+  MPMC_ShardedQueue(const std::size_t shardCount, const std::size_t capacity,
+                    const Allocator& allocator = Allocator())
+  {
+    if (shardCount < 1)
+    {
+      throw std::logic_error("Shard count must be positive");
+    }
+    shards_.reserve(shardCount);
+    for (std::size_t i {}; i < shardCount; ++i)
+    {
+      shards_.push_back(std::make_unique<queue_type>(capacity, allocator));
+    }
+  }
+
+  // non-copyable and non-movable
+  MPMC_ShardedQueue(const MPMC_ShardedQueue& lhs)        = delete;
+  MPMC_ShardedQueue(MPMC_ShardedQueue&& lhs)             = delete;
+  MPMC_ShardedQueue& operator=(const MPMC_ShardedQueue&) = delete;
+  MPMC_ShardedQueue& operator=(MPMC_ShardedQueue&&)      = delete;
+
+  ~MPMC_ShardedQueue() = default;
+
+  template <typename... Args>
+    requires std::constructible_from<T, Args...>
+  void emplace(Args&&... args) noexcept(MPMC_NoThrow_Type<T, Args&&...>)
+  {
+    auto const shard = home<details::producer_token>();
+    shards_[shard]->emplace(std::forward<Args>(args)...);
+  }
+
+  template <typename... Args>
+    requires std::constructible_from<T, Args...>
+  [[nodiscard]] bool try_emplace(Args&&... args) noexcept(
+      MPMC_NoThrow_Type<T, Args&&...>)
+  {
+    auto const start = home<details::producer_token>();
+    for (std::size_t i {}; i < shards_.size(); ++i)
+    {
+      auto const shard = (start + i) % shards_.size();
+      if (shards_[shard]->try_emplace(std::forward<Args>(args)...))
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void push(const T& val) noexcept(MPMC_NoThrow_Type<T>) { emplace(val); }
+
+  template <typename P>
+    requires std::constructible_from<T, P&&>
+  void push(P&& val) noexcept(MPMC_NoThrow_Type<T, P&&>)
+  {
+    emplace(std::forward<P>(val));
+  }
+
+  [[nodiscard]] bool try_push(const T& val) noexcept(MPMC_NoThrow_Type<T>)
+  {
+    return try_emplace(val);
+  }
+
+  template <typename P>
+    requires std::constructible_from<T, P&&>
+  [[nodiscard]] bool try_push(P&& val) noexcept(MPMC_NoThrow_Type<T, P&&>)
+  {
+    return try_emplace(std::forward<P>(val));
+  }
+
+  // A blocking pop cannot take a ticket on a single shard without waiting on
+  // that shard, so it polls every shard until one succeeds
+  void pop(T& val) noexcept
+  {
+    while (! try_pop(val)) { details::cpu_relax(); }
+  }
+
+  // Pops from the home shard first and then steals round robin
+  [[nodiscard]] bool try_pop(T& val) noexcept
+  {
+    auto const start = home<details::consumer_token>();
+    for (std::size_t i {}; i < shards_.size(); ++i)
+    {
+      auto const shard = (start + i) % shards_.size();
+      if (shards_[shard]->try_pop(val))
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Sum of the approximate shard sizes
+  [[nodiscard]] std::ptrdiff_t size() const noexcept
+  {
+    std::ptrdiff_t total {};
+    for (auto const& shard : shards_) { total += shard->size(); }
+    return total;
+  }
+
+  [[nodiscard]] bool empty() const noexcept { return size() <= 0; }
+
+  [[nodiscard]] std::size_t capacity() const noexcept
+  {
+    return shards_.size() * shards_.front()->capacity();
+  }
+
+  [[nodiscard]] std::size_t shard_count() const noexcept
+  {
+    return shards_.size();
+  }
+
+  [[nodiscard]] queue_type& shard(std::size_t index) noexcept
+  {
+    return *shards_[index];
+  }
+};
+}// namespace dro
+#endif
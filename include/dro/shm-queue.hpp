@@ -0,0 +1,423 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// Inter process dro::MPMC_Queue. The header with head, tail and capacity and
+// the flat Slot<T> array live in one shared mapping, a POSIX shared memory
+// object opened by name or a memfd passed between processes. Nothing in the
+// mapping is a pointer, each process finds the slots at an offset from its
+// own mapping address, so the mapping may land at different addresses.
+//
+// 1) T must be trivially copyable, the slots are copied between address
+//    spaces and are never destroyed.
+// 2) The header records a magic number, a layout version and the size and
+//    alignment of T and of the slots. Attaching to a mapping created with a
+//    different layout or element type throws.
+// 3) The creator publishes the header last, attaching before that throws.
+// 4) A process that dies between claiming a ticket and publishing its slot
+//    stalls the queue, as a thread would in dro::MPMC_Queue.
+
+#ifndef DRO_SHM_QUEUE
+#define DRO_SHM_QUEUE
+
+#include "dro/mpmc-queue.hpp"
+
+#include <atomic>      // for atomic, memory_order
+#include <cerrno>      // for errno
+#include <cstddef>     // for size_t, ptrdiff_t
+#include <cstdint>     // for uint32_t, uint64_t
+#include <fcntl.h>     // for O_CREAT, O_EXCL, O_RDWR
+#include <limits>      // for numeric_limits
+#include <new>         // for placement new
+#include <stdexcept>   // for logic_error, length_error, runtime_error
+#include <string>      // for string
+#include <sys/mman.h>  // for mmap, munmap, shm_open, memfd_create
+#include <sys/stat.h>  // for fstat
+#include <system_error>// for system_error
+#include <type_traits> // for is_trivially_copyable_v
+#include <unistd.h>    // for close, dup, ftruncate
+#include <utility>     // for forward
+
+namespace dro
+{
+
+// Constructor tags of MPMC_ShmQueue
+struct shm_create_t
+{
+  explicit shm_create_t() = default;
+};
+
+struct shm_attach_t
+{
+  explicit shm_attach_t() = default;
+};
+
+inline constexpr shm_create_t shm_create {};
+inline constexpr shm_attach_t shm_attach {};
+
+namespace details
+{
+inline constexpr std::uint64_t shmMagic         = 0x44524f4d504d4351;// DROMPMCQ
+inline constexpr std::uint32_t shmLayoutVersion = 1;
+
+struct shm_header
+{
+  std::uint64_t magic_;
+  // Zero until the creator has written the header
+  std::atomic<std::uint32_t> version_;
+  std::uint32_t valueSize_;
+  std::uint32_t valueAlign_;
+  std::uint32_t slotSize_;
+  std::uint64_t capacity_;
+  std::uint64_t slotsOffset_;
+  alignas(cacheLineSize) std::atomic<std::size_t> tail_;
+  alignas(cacheLineSize) std::atomic<std::size_t> head_;
+};
+
+[[noreturn]] inline void throw_errno(const char* what)
+{
+  throw std::system_error(errno, std::generic_category(), what);
+}
+}// namespace details
+
+template <MPMC_Type T>
+  requires std::is_trivially_copyable_v<T>
+class MPMC_ShmQueue
+{
+public:
+  using value_type = T;
+  using slot_type  = Slot<T>;
+
+private:
+  static_assert(std::atomic<std::size_t>::is_always_lock_free &&
+                    std::atomic<std::uint32_t>::is_always_lock_free,
+                "Atomics in shared memory must be address free");
+
+  static constexpr std::size_t SLOTS_OFFSET =
+      (sizeof(details::shm_header) + alignof(slot_type) - 1) /
+      alignof(slot_type) * alignof(slot_type);
+
+  int fd_ {-1};
+  std::size_t bytes_ {};
+  void* mapping_ {};
+  details::shm_header* header_ {};
+  slot_type* slots_ {};
+  std::size_t capacity_ {};
+
+  [[nodiscard]] static std::size_t mapping_bytes(std::size_t capacity)
+  {
+    if (capacity < 1)
+    {
+      throw std::logic_error("Capacity must be positive");
+    }
+    if (capacity > (std::numeric_limits<std::size_t>::max() - SLOTS_OFFSET) /
+                       sizeof(slot_type))
+    {
+      throw std::length_error("Capacity with padding exceeds std::size_t");
+    }
+    return SLOTS_OFFSET + capacity * sizeof(slot_type);
+  }
+
+  void map(std::size_t bytes)
+  {
+    bytes_   = bytes;
+    mapping_ = ::mmap(nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_,
+                      0);
+    if (mapping_ == MAP_FAILED)
+    {
+      mapping_ = nullptr;
+      details::throw_errno("mmap");
+    }
+    header_ = static_cast<details::shm_header*>(mapping_);
+  }
+
+  // The file contents are zero after ftruncate, the slots and indexes are
+  // constructed in place before the version publishes the header
+  void create(std::size_t capacity)
+  {
+    auto const bytes = mapping_bytes(capacity);
+    if (::ftruncate(fd_, static_cast<off_t>(bytes)) != 0)
+    {
+      details::throw_errno("ftruncate");
+    }
+    map(bytes);
+    capacity_ = capacity;
+    slots_    = reinterpret_cast<slot_type*>(static_cast<char*>(mapping_) +
+                                          SLOTS_OFFSET);
+    for (std::size_t i {}; i < capacity_; ++i) { new (&slots_[i]) slot_type(); }
+    new (&header_->tail_) std::atomic<std::size_t>(0);
+    new (&header_->head_) std::atomic<std::size_t>(0);
+    header_->magic_       = details::shmMagic;
+    header_->valueSize_   = sizeof(T);
+    header_->valueAlign_  = alignof(T);
+    header_->slotSize_    = sizeof(slot_type);
+    header_->capacity_    = capacity_;
+    header_->slotsOffset_ = SLOTS_OFFSET;
+    header_->version_.store(details::shmLayoutVersion,
+                            std::memory_order_release);
+  }
+
+  void attach()
+  {
+    struct stat info {};
+    if (::fstat(fd_, &info) != 0)
+    {
+      details::throw_errno("fstat");
+    }
+    auto const bytes = static_cast<std::size_t>(info.st_size);
+    if (bytes < sizeof(details::shm_header))
+    {
+      throw std::runtime_error("Shared memory queue is not initialized");
+    }
+    map(bytes);
+    auto const version = header_->version_.load(std::memory_order_acquire);
+    if (version == 0)
+    {
+      throw std::runtime_error("Shared memory queue is not initialized");
+    }
+    if (header_->magic_ != details::shmMagic ||
+        version != details::shmLayoutVersion)
+    {
+      throw std::runtime_error("Shared memory queue layout version mismatch");
+    }
+    if (header_->valueSize_ != sizeof(T) ||
+        header_->valueAlign_ != alignof(T) ||
+        header_->slotSize_ != sizeof(slot_type) ||
+        header_->slotsOffset_ != SLOTS_OFFSET ||
+        header_->capacity_ < 1 ||
+        mapping_bytes(header_->capacity_) > bytes_)
+    {
+      throw std::runtime_error("Shared memory queue element type mismatch");
+    }
+    capacity_ = header_->capacity_;
+    slots_    = reinterpret_cast<slot_type*>(static_cast<char*>(mapping_) +
+                                          header_->slotsOffset_);
+  }
+
+  void release() noexcept
+  {
+    if (mapping_)
+    {
+      ::munmap(mapping_, bytes_);
+    }
+    if (fd_ >= 0)
+    {
+      ::close(fd_);
+    }
+  }
+
+  // Runs the constructor body, unmapping and closing on failure since the
+  // destructor does not run for a throwing constructor
+  template <typename Init> void initialize(Init&& init)
+  {
+    try
+    {
+      init();
+    }
+    catch (...)
+    {
+      release();
+      throw;
+    }
+  }
+
+  [[nodiscard]] std::size_t turn(std::size_t ticket) const noexcept
+  {
+    return ticket / capacity_;
+  }
+
+  [[nodiscard]] slot_type& slot_at(std::size_t ticket) const noexcept
+  {
+    return slots_[ticket % capacity_];
+  }
+
+  [[nodiscard]] static std::ptrdiff_t
+  turn_distance(const slot_type& slot, std::size_t expected) noexcept
+  {
+    return static_cast<std::ptrdiff_t>(
+        slot.turn.load(std::memory_order_acquire) - expected);
+  }
+
+  static void wait_for(const slot_type& slot, std::size_t expected) noexcept
+  {
+    while (slot.turn.load(std::memory_order_acquire) != expected)
+    {
+      details::cpu_relax();
+    }
+  }
+
+public:
+  // Anonymous memfd queue, shared with children after fork() or with other
+  // processes by passing fd() over a unix socket
+  explicit MPMC_ShmQueue(const std::size_t capacity)
+      : fd_(::memfd_create("dro-mpmc-queue", MFD_CLOEXEC))
+  {
+    if (fd_ < 0)
+    {
+      details::throw_errno("memfd_create");
+    }
+    initialize([&] { create(capacity); });
+  }
+
+  // Creates the named shared memory object, fails if it exists
+  MPMC_ShmQueue(shm_create_t, const std::string& name,
+                const std::size_t capacity)
+      : fd_(::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600))
+  {
+    if (fd_ < 0)
+    {
+      details::throw_errno("shm_open");
+    }
+    initialize([&] {
+      try
+      {
+        create(capacity);
+      }
+      catch (...)
+      {
+        ::shm_unlink(name.c_str());
+        throw;
+      }
+    });
+  }
+
+  // Attaches to a named shared memory object created by another queue
+  MPMC_ShmQueue(shm_attach_t, const std::string& name)
+      : fd_(::shm_open(name.c_str(), O_RDWR, 0))
+  {
+    if (fd_ < 0)
+    {
+      details::throw_errno("shm_open");
+    }
+    initialize([&] { attach(); });
+  }
+
+  // Attaches to the fd() of another queue, the descriptor is duplicated
+  MPMC_ShmQueue(shm_attach_t, const int fd) : fd_(::dup(fd))
+  {
+    if (fd_ < 0)
+    {
+      details::throw_errno("dup");
+    }
+    initialize([&] { attach(); });
+  }
+
+  // non-copyable and non-movable
+  MPMC_ShmQueue(const MPMC_ShmQueue& lhs)        = delete;
+  MPMC_ShmQueue(MPMC_ShmQueue&& lhs)             = delete;
+  MPMC_ShmQueue& operator=(const MPMC_ShmQueue&) = delete;
+  MPMC_ShmQueue& operator=(MPMC_ShmQueue&&)      = delete;
+
+  // Unmaps this process' view, the shared memory object outlives it until it
+  // is unlinked
+  ~MPMC_ShmQueue() { release(); }
+
+  // Removes the name, attached queues keep their mapping
+  static void unlink(const std::string& name) noexcept
+  {
+    ::shm_unlink(name.c_str());
+  }
+
+  template <typename... Args>
+    requires std::constructible_from<T, Args...>
+  void emplace(Args&&... args) noexcept(MPMC_NoThrow_Type<T, Args&&...>)
+  {
+    auto const head = header_->head_.fetch_add(1, std::memory_order_relaxed);
+    auto& slot      = slot_at(head);
+    wait_for(slot, turn(head) * 2);
+    slot.assign_value(std::forward<Args>(args)...);
+    slot.turn.store(turn(head) * 2 + 1, std::memory_order_release);
+  }
+
+  template <typename... Args>
+    requires std::constructible_from<T, Args...>
+  [[nodiscard]] bool try_emplace(Args&&... args) noexcept(
+      MPMC_NoThrow_Type<T, Args&&...>)
+  {
+    auto head = header_->head_.load(std::memory_order_relaxed);
+    while (true)
+    {
+      auto& slot          = slot_at(head);
+      auto const distance = turn_distance(slot, turn(head) * 2);
+      if (distance == 0)
+      {
+        if (header_->head_.compare_exchange_weak(head, head + 1,
+                                                 std::memory_order_relaxed,
+                                                 std::memory_order_relaxed))
+        {
+          slot.assign_value(std::forward<Args>(args)...);
+          slot.turn.store(turn(head) * 2 + 1, std::memory_order_release);
+          return true;
+        }
+      }
+      else if (distance < 0)
+      {
+        return false;
+      }
+      else
+      {
+        head = header_->head_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  void push(const T& val) noexcept(MPMC_NoThrow_Type<T>) { emplace(val); }
+
+  [[nodiscard]] bool try_push(const T& val) noexcept(MPMC_NoThrow_Type<T>)
+  {
+    return try_emplace(val);
+  }
+
+  void pop(T& val) noexcept
+  {
+    auto const tail = header_->tail_.fetch_add(1, std::memory_order_relaxed);
+    auto& slot      = slot_at(tail);
+    wait_for(slot, turn(tail) * 2 + 1);
+    val = slot.return_value();
+    slot.turn.store(turn(tail) * 2 + 2, std::memory_order_release);
+  }
+
+  [[nodiscard]] bool try_pop(T& val) noexcept
+  {
+    auto tail = header_->tail_.load(std::memory_order_relaxed);
+    while (true)
+    {
+      auto& slot          = slot_at(tail);
+      auto const distance = turn_distance(slot, turn(tail) * 2 + 1);
+      if (distance == 0)
+      {
+        if (header_->tail_.compare_exchange_weak(tail, tail + 1,
+                                                 std::memory_order_relaxed,
+                                                 std::memory_order_relaxed))
+        {
+          val = slot.return_value();
+          slot.turn.store(turn(tail) * 2 + 2, std::memory_order_release);
+          return true;
+        }
+      }
+      else if (distance < 0)
+      {
+        return false;
+      }
+      else
+      {
+        tail = header_->tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Negative while consumers wait on an empty queue
+  [[nodiscard]] std::ptrdiff_t size() const noexcept
+  {
+    auto const tail = header_->tail_.load(std::memory_order_acquire);
+    auto const head = header_->head_.load(std::memory_order_acquire);
+    return static_cast<std::ptrdiff_t>(head - tail);
+  }
+
+  [[nodiscard]] bool empty() const noexcept { return size() <= 0; }
+
+  [[nodiscard]] std::size_t capacity() const noexcept { return capacity_; }
+
+  // The shared memory object, pass it to attach another process
+  [[nodiscard]] int fd() const noexcept { return fd_; }
+};
+}// namespace dro
+#endif
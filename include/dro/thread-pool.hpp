@@ -0,0 +1,281 @@
+// Andrew Drogalis Copyright (c) 2024, GNU 3.0 Licence
+//
+// Work stealing thread pool over dro::MPMC_Queue.
+//
+// 1) Each worker owns a local SingleProducer queue. Tasks submitted from a
+//    worker go to its local queue, tasks submitted from other threads go to a
+//    shared global injection queue.
+// 2) A worker pops its local queue, then the global queue, then tries to
+//    steal from the other local queues starting at a random victim.
+// 3) Tasks are InplaceFunction<void()> stored in place in the slots, a
+//    callable must fit in TaskCapacity bytes and be nothrow move
+//    constructible. No task allocates.
+// 4) Idle workers park on a per worker signal with the Wait policy, e.g.
+//    BlockingWait parks in std::atomic::wait after a short spin. A submit only
+//    looks for a parked worker when the idle count is non-zero.
+// 5) Tasks must not throw, an exception escaping a task calls std::terminate.
+//
+// Tasks queued when the pool is destroyed still run before the workers exit.
+
+#ifndef DRO_THREAD_POOL
+#define DRO_THREAD_POOL
+
+#include "dro/inplace-function.hpp"
+#include "dro/mpmc-queue.hpp"
+#include "dro/pin-thread.hpp"
+
+#include <atomic>     // for atomic, atomic_thread_fence, memory_order
+#include <concepts>   // for invocable
+#include <cstddef>    // for size_t
+#include <cstdint>    // for uint64_t
+#include <memory>     // for allocator, unique_ptr
+#include <stdexcept>  // for logic_error
+#include <thread>     // for thread
+#include <type_traits>// for decay_t
+#include <utility>    // for forward, move
+#include <vector>     // for vector
+
+namespace dro
+{
+
+// The default TaskCapacity fills a cache line aligned slot with the turn
+template <MPMC_Policy Wait           = BlockingWait<>,
+          std::size_t TaskCapacity = inplaceCapacity<cacheLineSize>>
+  requires std::same_as<typename Wait::policy_category, wait_policy>
+class ThreadPool
+{
+public:
+  using task_type = InplaceFunction<void(), TaskCapacity>;
+
+private:
+  using local_queue =
+      MPMC_Queue<task_type, std::allocator<Slot<task_type>>, SingleProducer>;
+  using global_queue = MPMC_Queue<task_type>;
+
+  struct worker
+  {
+    explicit worker(std::size_t capacity) : queue_(capacity) {}
+
+    local_queue queue_;
+    // Odd while the worker is parked, a waker moves it to the next even value
+    alignas(cacheLineSize) std::atomic<std::size_t> signal_ {0};
+  };
+
+  global_queue global_;
+  std::vector<std::unique_ptr<worker>> workers_;
+  std::vector<std::thread> threads_;
+  alignas(cacheLineSize) std::atomic<std::size_t> idle_ {0};
+  std::atomic<bool> stop_ {false};
+
+  inline static thread_local ThreadPool* currentPool_ {};
+  inline static thread_local std::size_t currentWorker_ {};
+
+  [[nodiscard]] static std::size_t next_random(std::uint64_t& state) noexcept
+  {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return static_cast<std::size_t>(state);
+  }
+
+  [[nodiscard]] bool find_task(std::size_t index, std::uint64_t& random,
+                               task_type& task) noexcept
+  {
+    if (workers_[index]->queue_.try_pop(task) || global_.try_pop(task))
+    {
+      return true;
+    }
+    auto const count = workers_.size();
+    auto const start = next_random(random) % count;
+    for (std::size_t i {}; i < count; ++i)
+    {
+      auto const victim = (start + i) % count;
+      if (victim != index && workers_[victim]->queue_.try_pop(task))
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  [[nodiscard]] bool has_work() const noexcept
+  {
+    if (! global_.empty())
+    {
+      return true;
+    }
+    for (auto const& w : workers_)
+    {
+      if (! w->queue_.empty())
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Moves a parked worker to its next even signal, returns false if it was
+  // not parked
+  static bool unpark(worker& w) noexcept
+  {
+    auto signal = w.signal_.load(std::memory_order_relaxed);
+    if ((signal & 1) &&
+        w.signal_.compare_exchange_strong(signal, signal + 1,
+                                          std::memory_order_relaxed))
+    {
+      Wait::notify(w.signal_);
+      return true;
+    }
+    return false;
+  }
+
+  void wake_one() noexcept
+  {
+    // Orders the push before the load, pairs with the fence in park()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (idle_.load(std::memory_order_acquire) == 0)
+    {
+      return;
+    }
+    for (auto& w : workers_)
+    {
+      if (unpark(*w))
+      {
+        return;
+      }
+    }
+  }
+
+  void park(std::size_t index) noexcept
+  {
+    auto& signal      = workers_[index]->signal_;
+    auto const parked = signal.load(std::memory_order_relaxed) + 1;
+    signal.store(parked, std::memory_order_relaxed);
+    idle_.fetch_add(1, std::memory_order_release);
+    // Orders the announcement before the recheck, pairs with the fence in
+    // wake_one() and shutdown()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (has_work() || stop_.load(std::memory_order_relaxed))
+    {
+      // Fails when a waker has already moved the signal on
+      auto expected = parked;
+      signal.compare_exchange_strong(expected, parked + 1,
+                                     std::memory_order_relaxed);
+    }
+    else
+    {
+      Wait::wait(signal, parked + 1);
+    }
+    idle_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  void run(std::size_t index) noexcept
+  {
+    currentPool_   = this;
+    currentWorker_ = index;
+    std::uint64_t random {index * 0x9e3779b97f4a7c15 + 1};
+    task_type task;
+    while (true)
+    {
+      if (find_task(index, random, task))
+      {
+        task();
+        task.reset();
+      }
+      else if (stop_.load(std::memory_order_acquire))
+      {
+        return;
+      }
+      else
+      {
+        park(index);
+      }
+    }
+  }
+
+  void shutdown() noexcept
+  {
+    stop_.store(true, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for (auto& w : workers_)
+    {
+      while (w->signal_.load(std::memory_order_relaxed) & 1) { unpark(*w); }
+    }
+    for (auto& thread : threads_) { thread.join(); }
+    threads_.clear();
+  }
+
+public:
+  // capacity is per queue, worker i is pinned to cpus[i % cpus.size()]
+  explicit ThreadPool(const std::size_t threads,
+                      const std::size_t capacity = 1024,
+                      const std::vector<int>& cpus = {})
+      : global_(capacity)
+  {
+    if (threads < 1)
+    {
+      throw std::logic_error("Thread count must be positive");
+    }
+    workers_.reserve(threads);
+    for (std::size_t i {}; i < threads; ++i)
+    {
+      workers_.push_back(std::make_unique<worker>(capacity));
+    }
+    try
+    {
+      threads_.reserve(threads);
+      for (std::size_t i {}; i < threads; ++i)
+      {
+        threads_.emplace_back([this, i] { run(i); });
+        if (! cpus.empty())
+        {
+          pinThread(threads_.back(), cpus[i % cpus.size()]);
+        }
+      }
+    }
+    catch (...)
+    {
+      shutdown();
+      throw;
+    }
+  }
+
+  // non-copyable and non-movable
+  ThreadPool(const ThreadPool& lhs)        = delete;
+  ThreadPool(ThreadPool&& lhs)             = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  ThreadPool& operator=(ThreadPool&&)      = delete;
+
+  ~ThreadPool() { shutdown(); }
+
+  // From a worker the task goes to its local queue, from other threads to the
+  // global queue, which blocks while full. A worker whose local and global
+  // queues are both full runs the task itself.
+  template <typename F>
+    requires std::invocable<std::decay_t<F>&>
+  void submit(F&& f)
+  {
+    task_type task(std::forward<F>(f));
+    if (currentPool_ == this)
+    {
+      if (! workers_[currentWorker_]->queue_.try_push(std::move(task)) &&
+          ! global_.try_push(std::move(task)))
+      {
+        task();
+        return;
+      }
+    }
+    else
+    {
+      global_.push(std::move(task));
+    }
+    wake_one();
+  }
+
+  [[nodiscard]] std::size_t thread_count() const noexcept
+  {
+    return workers_.size();
+  }
+};
+}// namespace dro
+#endif
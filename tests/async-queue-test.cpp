@@ -0,0 +1,120 @@
+#include "dro/async-queue.hpp"
+#include <atomic>
+#include <cassert>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Starts eagerly and frees its frame when it finishes
+struct Detached
+{
+  struct promise_type
+  {
+    Detached get_return_object() noexcept { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() noexcept {}
+    void unhandled_exception() noexcept { std::terminate(); }
+  };
+};
+
+template <typename Queue>
+Detached consume(Queue& q, uint64_t count, std::atomic<uint64_t>& sum,
+                 std::atomic<uint64_t>& done)
+{
+  for (uint64_t i = 0; i < count; ++i)
+  {
+    sum.fetch_add(co_await q.async_pop(), std::memory_order_relaxed);
+  }
+  done.fetch_add(1, std::memory_order_release);
+}
+
+template <typename Queue>
+Detached produce(Queue& q, uint64_t first, uint64_t step, uint64_t last,
+                 std::atomic<uint64_t>& done)
+{
+  for (auto i = first; i < last; i += step) { co_await q.async_push(i); }
+  done.fetch_add(1, std::memory_order_release);
+}
+
+int main(int argc, char* argv[])
+{
+
+  // A suspended consumer is resumed by a push
+  {
+    dro::MPMC_AsyncQueue<uint64_t> q {2};
+    std::atomic<uint64_t> sum(0);
+    std::atomic<uint64_t> done(0);
+    consume(q, 2, sum, done);
+    assert(done == 0 && q.empty());
+    q.push(3);
+    assert(sum == 3 && done == 0);
+    assert(q.try_push(4) == true);
+    assert(sum == 7 && done == 1 && q.empty());
+  }
+
+  // A suspended producer is resumed by a pop
+  {
+    dro::MPMC_AsyncQueue<uint64_t> q {1};
+    std::atomic<uint64_t> done(0);
+    produce(q, 0, 1, 3, done);
+    assert(done == 0 && q.size() == 1);
+    uint64_t t = 9;
+    assert(q.try_pop(t) == true && t == 0);
+    assert(q.size() == 1);
+    q.pop(t);
+    assert(t == 1 && done == 1 && q.size() == 1);
+    assert(q.try_pop(t) == true && t == 2 && q.empty());
+  }
+
+  // Consumers and producers waiting at the same time on a move only type
+  {
+    dro::MPMC_AsyncQueue<std::unique_ptr<int>> q {1};
+    std::atomic<uint64_t> done(0);
+    auto pop = [&]() -> Detached {
+      auto p = co_await q.async_pop();
+      assert(p && *p == 5);
+      done.fetch_add(1);
+    };
+    pop();
+    pop();
+    q.push(std::make_unique<int>(5));
+    assert(done == 1);
+    auto push = [&]() -> Detached {
+      co_await q.async_push(std::make_unique<int>(5));
+      done.fetch_add(1);
+    };
+    push();
+    assert(done == 3 && q.empty());
+  }
+
+  // Fuzz test, coroutines are resumed on whichever thread serves them
+  {
+    const uint64_t numOps     = 100'000;
+    const uint64_t numThreads = 4;
+    dro::MPMC_AsyncQueue<uint64_t> q {4};
+    std::atomic<uint64_t> sum(0);
+    std::atomic<uint64_t> done(0);
+    std::vector<std::thread> threads;
+    for (uint64_t i = 0; i < numThreads; ++i)
+    {
+      threads.push_back(std::thread(
+          [&, i] { produce(q, i, numThreads, numOps, done); }));
+      threads.push_back(std::thread(
+          [&] { consume(q, numOps / numThreads, sum, done); }));
+    }
+    for (auto& thread : threads) { thread.join(); }
+    while (done.load(std::memory_order_acquire) < 2 * numThreads)
+    {
+      std::this_thread::yield();
+    }
+    assert(sum == numOps * (numOps - 1) / 2 && q.empty());
+  }
+
+  std::cout << "Test Completed!\n";
+  return 0;
+}
@@ -0,0 +1,154 @@
+#include "dro/broadcast-queue.hpp"
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main(int argc, char* argv[])
+{
+
+  // Every consumer reads every element, the slowest consumer gates the ring
+  {
+    dro::BroadcastQueue<std::string> q {2, 2};
+    assert(q.capacity() == 2 && q.consumer_count() == 2);
+    std::string t;
+    assert(q.try_pop(0, t) == false && q.empty(0));
+    q.push("a");
+    assert(q.try_emplace(1, 'b') == true);
+    assert(q.try_push("c") == false);
+    assert(q.size(0) == 2 && q.size(1) == 2);
+    assert(q.try_pop(0, t) == true && t == "a");
+    assert(q.try_pop(0, t) == true && t == "b");
+    assert(q.try_pop(0, t) == false);
+    // Consumer 1 has not read either element
+    assert(q.try_push("c") == false);
+    auto called = false;
+    assert(q.try_read(1, [&](const std::string& s) {
+      called = s == "a";
+    }) == true);
+    assert(called);
+    assert(q.try_push("c") == true);
+    assert(q.try_pop(1, t) == true && t == "b");
+    assert(q.try_pop(1, t) == true && t == "c");
+    assert(q.try_pop(0, t) == true && t == "c");
+    assert(q.empty(0) && q.empty(1));
+  }
+
+  // Lossy overwrites the oldest element and counts the gap
+  {
+    dro::BroadcastQueue<int, true> q {4, 2};
+    int t = 0;
+    for (int i = 0; i < 10; ++i) { assert(q.try_push(i) == true); }
+    assert(q.size(0) == 4);
+    assert(q.try_pop(0, t) == true && t == 6);
+    assert(q.lost(0) == 6 && q.lost(1) == 0);
+    for (int i = 7; i < 10; ++i) { assert(q.try_pop(0, t) && t == i); }
+    assert(q.try_pop(0, t) == false);
+    q.push(10);
+    assert(q.try_pop(0, t) == true && t == 10 && q.lost(0) == 6);
+    assert(q.try_pop(1, t) == true && t == 7 && q.lost(1) == 7);
+  }
+
+  // Lossy ring lapped several times, the gap is bounded by the pushes
+  {
+    dro::BroadcastQueue<int, true> q {4, 1};
+    int t = 0, read = 0;
+    for (int i = 0; i < 23; ++i) { assert(q.try_push(i) == true); }
+    while (q.try_pop(0, t)) { ++read; }
+    assert(t == 22 && read == 4);
+    assert(q.lost(0) <= 23 && read + q.lost(0) == 23);
+  }
+
+  {
+    bool throws = false;
+    try
+    {
+      dro::BroadcastQueue<int> q {0, 1};
+    }
+    catch (const std::logic_error&)
+    {
+      throws = true;
+    }
+    assert(throws == true);
+
+    throws = false;
+    try
+    {
+      dro::BroadcastQueue<int> q {4, 0};
+    }
+    catch (const std::logic_error&)
+    {
+      throws = true;
+    }
+    assert(throws == true);
+  }
+
+  // Fuzz test
+  {
+    const uint64_t numOps       = 100'000;
+    const uint64_t numConsumers = 4;
+    dro::BroadcastQueue<uint64_t> q {16, numConsumers};
+    std::vector<uint64_t> sums(numConsumers);
+    std::vector<std::thread> threads;
+    for (uint64_t i = 0; i < numConsumers; ++i)
+    {
+      threads.push_back(std::thread([&, i] {
+        uint64_t t = 0;
+        for (uint64_t j = 0; j < numOps; ++j)
+        {
+          q.pop(i, t);
+          assert(t == j);
+          sums[i] += t;
+        }
+      }));
+    }
+    threads.push_back(std::thread([&] {
+      for (uint64_t j = 0; j < numOps; ++j) { q.push(j); }
+    }));
+    for (auto& thread : threads) { thread.join(); }
+    for (auto sum : sums) { assert(sum == numOps * (numOps - 1) / 2); }
+  }
+
+  // Lossy fuzz test, every consumer reads an increasing sequence and the
+  // element read plus the gaps account for every element
+  {
+    const uint64_t numOps       = 100'000;
+    const uint64_t numConsumers = 2;
+    dro::BroadcastQueue<uint64_t, true> q {8, numConsumers};
+    std::atomic<bool> done {false};
+    std::vector<std::thread> threads;
+    for (uint64_t i = 0; i < numConsumers; ++i)
+    {
+      threads.push_back(std::thread([&, i] {
+        uint64_t t = 0, read = 0, last = 0;
+        while (true)
+        {
+          auto const finished = done.load(std::memory_order_acquire);
+          if (q.try_pop(i, t))
+          {
+            assert(read == 0 || t > last);
+            last = t;
+            ++read;
+          }
+          else if (finished)
+          {
+            break;
+          }
+        }
+        assert(read + q.lost(i) == numOps && last == numOps - 1);
+      }));
+    }
+    threads.push_back(std::thread([&] {
+      for (uint64_t j = 0; j < numOps; ++j) { q.push(j); }
+      done.store(true, std::memory_order_release);
+    }));
+    for (auto& thread : threads) { thread.join(); }
+  }
+
+  std::cout << "Test Completed!\n";
+  return 0;
+}
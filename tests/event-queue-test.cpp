@@ -0,0 +1,152 @@
+#include "dro/event-queue.hpp"
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Whether fd() is readable without waiting
+template <typename Queue> bool readable(const Queue& q)
+{
+  pollfd event {q.fd(), POLLIN, 0};
+  return ::poll(&event, 1, 0) == 1;
+}
+
+int main(int argc, char* argv[])
+{
+
+  {
+    dro::MPMC_EventQueue<int> q {4};
+    assert(q.fd() >= 0 && q.capacity() == 4);
+    int t = 0;
+    // No notification while no consumer is armed
+    q.push(1);
+    assert(! readable(q));
+    assert(q.arm() == false);
+    assert(q.try_pop(t) == true && t == 1);
+    // An armed consumer is notified once per burst
+    assert(q.arm() == true);
+    assert(! readable(q));
+    q.push(2);
+    assert(q.try_push(3) == true);
+    assert(readable(q));
+    std::uint64_t count {};
+    assert(::read(q.fd(), &count, sizeof(count)) == sizeof(count));
+    assert(count == 1);
+    q.disarm();
+    assert(! readable(q));
+    assert(q.try_pop(t) == true && t == 2);
+    assert(q.try_pop(t) == true && t == 3);
+    // Bulk pushes notify once
+    assert(q.arm() == true);
+    std::vector<int> in {4, 5, 6, 7, 8};
+    assert(q.try_push_bulk(in.begin(), in.end()) == 4);
+    assert(q.try_push_bulk(in.begin(), in.end()) == 0);
+    assert(readable(q));
+    q.disarm();
+    std::vector<int> out(4);
+    assert(q.try_pop_bulk(out.begin(), 4) == 4);
+    assert(out[0] == 4 && out[3] == 7);
+    assert(q.empty() && ! readable(q));
+  }
+
+  {
+    dro::MPMC_EventQueue<std::unique_ptr<int>> q {2};
+    q.emplace(std::make_unique<int>(1));
+    assert(q.try_emplace(std::make_unique<int>(2)) == true);
+    std::unique_ptr<int> t;
+    q.pop(t);
+    assert(t && *t == 1);
+    q.pop(t);
+    assert(t && *t == 2);
+    // Elements left in the queue are destroyed with it
+    q.push(std::make_unique<int>(3));
+  }
+
+  // Consumers sleep in pop() while producers push in bursts
+  {
+    const uint64_t numOps     = 10'000;
+    const uint64_t numThreads = 2;
+    dro::MPMC_EventQueue<uint64_t> q {16};
+    std::vector<std::thread> threads;
+    std::atomic<uint64_t> sum(0);
+    for (uint64_t i = 0; i < numThreads; ++i)
+    {
+      threads.push_back(std::thread([&, i] {
+        for (auto j = i; j < numOps; j += numThreads)
+        {
+          q.push(j);
+          if (j % 1000 < numThreads)
+          {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+          }
+        }
+      }));
+    }
+    for (uint64_t i = 0; i < numThreads; ++i)
+    {
+      threads.push_back(std::thread([&, i] {
+        uint64_t threadSum = 0;
+        for (auto j = i; j < numOps; j += numThreads)
+        {
+          uint64_t v;
+          q.pop(v);
+          threadSum += v;
+        }
+        sum += threadSum;
+      }));
+    }
+    for (auto& thread : threads) { thread.join(); }
+    assert(sum == numOps * (numOps - 1) / 2);
+  }
+
+  // Event loop consumer multiplexing the queue with epoll
+  {
+    const uint64_t numOps = 1'000;
+    dro::MPMC_EventQueue<uint64_t> q {8};
+    int const epoll = ::epoll_create1(EPOLL_CLOEXEC);
+    assert(epoll >= 0);
+    epoll_event event {};
+    event.events  = EPOLLIN;
+    event.data.fd = q.fd();
+    assert(::epoll_ctl(epoll, EPOLL_CTL_ADD, q.fd(), &event) == 0);
+    auto producer = std::thread([&] {
+      for (uint64_t j {}; j < numOps; ++j)
+      {
+        q.push(j);
+        if (j % 100 == 0)
+        {
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+      }
+    });
+    uint64_t received {};
+    uint64_t v;
+    while (received < numOps)
+    {
+      while (q.try_pop(v))
+      {
+        assert(v == received);
+        ++received;
+      }
+      if (received < numOps && q.arm())
+      {
+        epoll_event ready {};
+        assert(::epoll_wait(epoll, &ready, 1, -1) == 1);
+        assert(ready.data.fd == q.fd());
+        q.disarm();
+      }
+    }
+    producer.join();
+    ::close(epoll);
+  }
+
+  std::cout << "Test Completed!\n";
+  return 0;
+}
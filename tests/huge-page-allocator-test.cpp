@@ -0,0 +1,138 @@
+#include "dro/huge-page-allocator.hpp"
+#include "dro/mpmc-queue.hpp"
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// Default initialization is a no op, but the destructor has to run
+struct Destroyed
+{
+  static inline int count = 0;
+  int value;
+  ~Destroyed() { ++count; }
+};
+
+int main(int argc, char* argv[])
+{
+
+  // Allocations are huge page aligned and writable end to end
+  {
+    dro::HugePageAllocator<int> alloc;
+    int* ptr = alloc.allocate(1000);
+    assert(reinterpret_cast<std::uintptr_t>(ptr) % 4096 == 0);
+    for (int i {}; i < 1000; ++i) { ptr[i] = i; }
+    assert(ptr[999] == 999);
+    alloc.deallocate(ptr, 1000);
+    assert(alloc == dro::HugePageAllocator<double>());
+  }
+
+  {
+    using Alloc = dro::HugePageAllocator<dro::Slot<int>>;
+    dro::MPMC_Queue<int, Alloc> q(100'000);
+    assert(q.capacity() == 100'000);
+    for (int i {}; i < 100'000; ++i) { q.push(i); }
+    int t = -1;
+    assert(q.try_push(0) == false);
+    for (int i {}; i < 100'000; ++i)
+    {
+      q.pop(t);
+      assert(t == i);
+    }
+    assert(q.try_pop(t) == false);
+  }
+
+  // Node 0 exists on every Linux system
+  {
+    using Alloc = dro::NumaAllocator<dro::Slot<int>>;
+    dro::MPMC_Queue<int, Alloc> q(10'000, Alloc(0));
+    const int iters = 100'000;
+    auto thrd       = std::thread([&] {
+      for (int i {}; i < iters; ++i) { q.push(i); }
+    });
+    int t = -1;
+    for (int i {}; i < iters; ++i)
+    {
+      q.pop(t);
+      assert(t == i);
+    }
+    thrd.join();
+  }
+
+  {
+    dro::NumaAllocator<int> alloc(0);
+    dro::NumaAllocator<double> rebound(alloc);
+    assert(rebound.node() == 0 && rebound == alloc);
+    assert(dro::NumaAllocator<int>(1) != alloc);
+
+    bool throws = false;
+    try
+    {
+      dro::NumaAllocator<int> invalid(-1);
+      [[maybe_unused]] int* ptr = invalid.allocate(1);
+    }
+    catch (const std::logic_error&)
+    {
+      throws = true;
+    }
+    assert(throws == true);
+  }
+
+  // Zero filled, page aligned and lazily faulted
+  {
+    static_assert(dro::MPMC_Zeroed_Allocator<dro::ZeroedPageAllocator<int>>);
+    static_assert(dro::MPMC_Zeroed_Allocator<dro::HugePageAllocator<int>>);
+    static_assert(! dro::MPMC_Zeroed_Allocator<std::allocator<int>>);
+    dro::ZeroedPageAllocator<int> alloc;
+    int* ptr = alloc.allocate(100'000);
+    assert(reinterpret_cast<std::uintptr_t>(ptr) % 4096 == 0);
+    for (int i {}; i < 100'000; ++i) { assert(ptr[i] == 0); }
+    alloc.deallocate(ptr, 100'000);
+    assert(alloc == dro::ZeroedPageAllocator<double>());
+
+    bool throws = false;
+    try
+    {
+      [[maybe_unused]] int* invalid = alloc.allocate(SIZE_MAX);
+    }
+    catch (const std::bad_array_new_length&)
+    {
+      throws = true;
+    }
+    assert(throws == true);
+  }
+
+  // Slots are not constructed one by one, prefault() keeps the contents
+  {
+    using Alloc = dro::ZeroedPageAllocator<dro::Slot<int>>;
+    dro::MPMC_Queue<int, Alloc> q(100'000);
+    q.prefault();
+    for (int i {}; i < 1000; ++i) { q.push(i); }
+    q.prefault();
+    int t = -1;
+    for (int i {}; i < 1000; ++i)
+    {
+      q.pop(t);
+      assert(t == i);
+    }
+    assert(q.try_pop(t) == false && q.empty());
+  }
+
+  // A non trivial destructor takes the constructing path, every destroyed
+  // slot was constructed
+  {
+    using Alloc = dro::ZeroedPageAllocator<dro::Slot<Destroyed>>;
+    {
+      dro::MPMC_Queue<Destroyed, Alloc> q(8);
+      Destroyed::count = 0;
+    }
+    assert(Destroyed::count == 8);
+  }
+
+  std::cout << "Test Completed!\n";
+  return 0;
+}
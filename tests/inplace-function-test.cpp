@@ -0,0 +1,115 @@
+#include "dro/inplace-function.hpp"
+#include "dro/mpmc-queue.hpp"
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Counted
+{
+  static inline int live = 0;
+  int value_ {};
+  Counted(int value) : value_(value) { ++live; }
+  Counted(Counted&& other) noexcept : value_(other.value_) { ++live; }
+  ~Counted() { --live; }
+};
+
+int main(int argc, char* argv[])
+{
+
+  // Both types fill a slot and keep the queue noexcept
+  {
+    using Function = dro::InplaceFunction<int(int)>;
+    using Any      = dro::InplaceAny<>;
+    static_assert(dro::MPMC_Type<Function> && dro::MPMC_NoThrow_Type<Function>);
+    static_assert(dro::MPMC_Type<Any> && dro::MPMC_NoThrow_Type<Any>);
+    static_assert(sizeof(dro::Slot<Function>) == dro::cacheLineSize);
+    static_assert(sizeof(dro::Slot<Any>) == dro::cacheLineSize);
+    using Wide = dro::InplaceFunction<void(), dro::inplaceCapacity<128>>;
+    static_assert(sizeof(dro::Slot<Wide, 128>) == 128);
+  }
+
+  // Calls, moves and resets
+  {
+    dro::InplaceFunction<int(int)> f;
+    assert(! f);
+    int offset = 3;
+    f          = [offset](int x) { return x + offset; };
+    assert(f && f(4) == 7);
+    auto g = std::move(f);
+    assert(! f && g(1) == 4);
+    g.reset();
+    assert(! g);
+
+    // Move only captures and converting returns
+    auto ptr = std::make_unique<int>(5);
+    dro::InplaceFunction<long()> h([p = std::move(ptr)] { return *p; });
+    assert(h() == 5L);
+  }
+
+  // Stored values are destroyed exactly once
+  {
+    {
+      dro::InplaceFunction<int()> f([c = Counted(2)] { return c.value_; });
+      assert(Counted::live == 1);
+      dro::InplaceFunction<int()> g;
+      g = std::move(f);
+      assert(Counted::live == 1 && g() == 2);
+      dro::InplaceAny<> a(Counted(4));
+      assert(Counted::live == 2);
+      a.emplace<int>(1);
+      assert(Counted::live == 1);
+    }
+    assert(Counted::live == 0);
+  }
+
+  // InplaceAny type checks
+  {
+    dro::InplaceAny<> a;
+    assert(! a.has_value() && a.get_if<int>() == nullptr);
+    a = dro::InplaceAny<>(std::string(40, 'x'));
+    assert(a.holds<std::string>() && ! a.holds<int>());
+    assert(a.get_if<std::string>()->size() == 40);
+    assert(a.get_if<int>() == nullptr);
+    auto& d = a.emplace<double>(1.5);
+    assert(a.holds<double>() && d == 1.5);
+    dro::InplaceAny<> b(std::move(a));
+    assert(! a.has_value() && *b.get_if<double>() == 1.5);
+  }
+
+  // Fuzz test
+  {
+    const uint64_t numOps     = 100'000;
+    const uint64_t numThreads = 4;
+    dro::MPMC_Queue<dro::InplaceFunction<void(uint64_t&)>> queue(16);
+    std::vector<uint64_t> sums(numThreads);
+    std::vector<std::thread> threads;
+    for (uint64_t i = 0; i < numThreads; ++i)
+    {
+      threads.push_back(std::thread([&, i] {
+        for (auto j = i; j < numOps; j += numThreads)
+        {
+          queue.push([j](uint64_t& sum) { sum += j; });
+        }
+      }));
+      threads.push_back(std::thread([&, i] {
+        dro::InplaceFunction<void(uint64_t&)> task;
+        for (auto j = i; j < numOps; j += numThreads)
+        {
+          queue.pop(task);
+          task(sums[i]);
+        }
+      }));
+    }
+    for (auto& thread : threads) { thread.join(); }
+    uint64_t sum = 0;
+    for (auto s : sums) { sum += s; }
+    assert(sum == numOps * (numOps - 1) / 2);
+  }
+
+  std::cout << "Test Completed!\n";
+  return 0;
+}
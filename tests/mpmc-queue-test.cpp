@@ -1,10 +1,96 @@
 
 #include "dro/mpmc-queue.hpp"
+#include <array>
+#include <atomic>
 #include <cassert>
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
 #include <memory>
+#include <numeric>
 #include <thread>
+#include <vector>
+
+// Blocking push and pop across threads with the given wait strategy
+template <typename WaitStrategy> void testWaitStrategy()
+{
+  const int numOps = 256;
+  dro::MPMC_Queue<int, std::allocator<dro::Slot<int>>, WaitStrategy> q {4};
+  auto thrd = std::thread([&] {
+    for (int i {}; i < numOps; ++i) { q.push(i); }
+  });
+  for (int i {}; i < numOps; ++i)
+  {
+    int t = -1;
+    q.pop(t);
+    assert(t == i);
+  }
+  thrd.join();
+}
+
+// Counts the live objects, each slot holds one for the lifetime of the queue
+struct LiveCount
+{
+  static inline int live = 0;
+  int value              = 0;
+
+  LiveCount() noexcept { ++live; }
+  LiveCount(int v) noexcept : value(v) { ++live; }
+  LiveCount(const LiveCount& other) noexcept : value(other.value) { ++live; }
+  LiveCount& operator=(const LiveCount&) noexcept = default;
+  ~LiveCount() noexcept { --live; }
+};
+
+// Every producer thread pushes numOps values which are summed by the consumers
+template <typename ProducerKind, typename ConsumerKind>
+void testProducerConsumerKind(uint64_t numProducers, uint64_t numConsumers)
+{
+  const uint64_t numOps = 1000;
+  dro::MPMC_Queue<uint64_t, std::allocator<dro::Slot<uint64_t>>, ProducerKind,
+                  ConsumerKind>
+      q {8};
+  std::vector<std::thread> threads;
+  std::atomic<uint64_t> sum(0);
+  for (uint64_t i = 0; i < numProducers; ++i)
+  {
+    threads.push_back(std::thread([&] {
+      for (uint64_t j {}; j < numOps; ++j)
+      {
+        if (j % 2)
+        {
+          q.push(j);
+        }
+        else
+        {
+          while (! q.try_push(j)) {}
+        }
+      }
+    }));
+  }
+  for (uint64_t i = 0; i < numConsumers; ++i)
+  {
+    threads.push_back(std::thread([&] {
+      uint64_t threadSum = 0;
+      for (uint64_t j {}; j < numOps * numProducers / numConsumers; ++j)
+      {
+        uint64_t v;
+        if (j % 2)
+        {
+          q.pop(v);
+        }
+        else
+        {
+          while (! q.try_pop(v)) {}
+        }
+        threadSum += v;
+      }
+      sum += threadSum;
+    }));
+  }
+  for (auto& thread : threads) { thread.join(); }
+  assert(sum == numProducers * numOps * (numOps - 1) / 2);
+}
 
 int main(int argc, char* argv[])
 {
@@ -22,6 +108,261 @@ int main(int argc, char* argv[])
     assert(q.size() == 0 && q.empty());
   }
 
+  // Power of two capacity
+  {
+    dro::MPMC_Queue<int, std::allocator<dro::Slot<int>>,
+                    dro::PowerOfTwoCapacity>
+        q {5};
+    assert(q.capacity() == 8);
+    int t = 0;
+    for (int i {}; i < 8; ++i) { assert(q.try_push(i) == true); }
+    assert(q.try_push(8) == false);
+    for (int i {}; i < 8; ++i) { assert(q.try_pop(t) == true && t == i); }
+    assert(q.try_pop(t) == false);
+    // Wraps around the ring several times
+    for (int i {}; i < 100; ++i)
+    {
+      q.push(i);
+      q.pop(t);
+      assert(t == i);
+    }
+  }
+
+  // Fixed capacity
+  {
+    dro::MPMC_Queue<int, std::allocator<dro::Slot<int>>,
+                    dro::FixedCapacity<3>>
+        q;
+    assert(q.capacity() == 4);
+    int t = 0;
+    for (int i {}; i < 4; ++i) { assert(q.try_push(i) == true); }
+    assert(q.try_push(4) == false);
+    for (int i {}; i < 4; ++i) { assert(q.try_pop(t) == true && t == i); }
+    for (int i {}; i < 100; ++i)
+    {
+      q.push(i);
+      q.pop(t);
+      assert(t == i);
+    }
+  }
+
+  // Packed slots
+  {
+    using Queue =
+        dro::MPMC_Queue<int, std::allocator<dro::Slot<int>>, dro::PackedSlots>;
+    static_assert(sizeof(Queue::slot_type) < dro::cacheLineSize);
+    Queue q {10};
+    // Rounded up to whole cache lines of slots
+    assert(q.capacity() % (dro::cacheLineSize / sizeof(Queue::slot_type)) ==
+           0);
+    assert(q.capacity() >= 10);
+    int t = 0;
+    for (int i {}; i < q.capacity(); ++i) { assert(q.try_push(i) == true); }
+    assert(q.try_push(-1) == false);
+    for (int i {}; i < q.capacity(); ++i)
+    {
+      assert(q.try_pop(t) == true && t == i);
+    }
+    for (int i {}; i < 100; ++i)
+    {
+      q.push(i);
+      q.pop(t);
+      assert(t == i);
+    }
+  }
+
+  // Packed slots with power of two capacity
+  {
+    dro::MPMC_Queue<int, std::allocator<dro::Slot<int>>, dro::PackedSlots,
+                    dro::PowerOfTwoCapacity>
+        q {1};
+    int t = 0;
+    for (int i {}; i < q.capacity(); ++i) { assert(q.try_push(i) == true); }
+    assert(q.try_push(-1) == false);
+    for (int i {}; i < 3 * q.capacity(); ++i)
+    {
+      assert(q.try_pop(t) == true && t == i);
+      assert(q.try_push(i + q.capacity()) == true);
+    }
+  }
+
+  // Turn aligned slots
+  {
+    using Queue = dro::MPMC_Queue<int, std::allocator<dro::Slot<int>>,
+                                  dro::TurnAlignedSlots>;
+    static_assert(sizeof(Queue::slot_type) == 2 * dro::cacheLineSize);
+    static_assert(offsetof(Queue::slot_type, turn) == dro::cacheLineSize);
+    Queue q {10};
+    assert(q.capacity() == 10);
+    int t = 0;
+    for (int i {}; i < q.capacity(); ++i) { assert(q.try_push(i) == true); }
+    assert(q.try_push(-1) == false);
+    for (int i {}; i < 3 * q.capacity(); ++i)
+    {
+      assert(q.try_pop(t) == true && t == i);
+      assert(q.try_push(i + q.capacity()) == true);
+    }
+  }
+
+  // Bulk operations
+  {
+    dro::MPMC_Queue<int> q {4};
+    std::vector<int> in {1, 2, 3, 4, 5, 6};
+    std::vector<int> out(6);
+    assert(q.try_push_bulk(in.begin(), in.end()) == 4);
+    assert(q.size() == 4);
+    assert(q.try_push_bulk(in.begin(), in.end()) == 0);
+    assert(q.try_pop_bulk(out.begin(), 3) == 3);
+    assert(out[0] == 1 && out[1] == 2 && out[2] == 3);
+    assert(q.try_push_bulk(in.begin() + 4, in.end()) == 2);
+    assert(q.try_pop_bulk(out.begin(), 6) == 3);
+    assert(out[0] == 4 && out[1] == 5 && out[2] == 6);
+    assert(q.try_pop_bulk(out.begin(), 6) == 0);
+    // Empty ranges return without claiming a ticket
+    assert(q.try_push_bulk(in.begin(), in.begin()) == 0);
+    assert(q.try_push_bulk(in.begin(), in.begin() + 1) == 1);
+    assert(q.try_pop_bulk(out.begin(), 0) == 0);
+    assert(q.try_pop_bulk(out.begin(), 1) == 1 && out[0] == 1);
+    // Blocking bulk operations larger than the capacity
+    std::vector<int> large(100);
+    std::iota(large.begin(), large.end(), 0);
+    auto thrd = std::thread([&] { q.push_bulk(large.begin(), large.end()); });
+    std::vector<int> result;
+    q.pop_bulk(std::back_inserter(result), large.size());
+    thrd.join();
+    assert(result == large);
+  }
+
+  // Bulk operations with a move only type
+  {
+    dro::MPMC_Queue<std::unique_ptr<int>> q {8};
+    std::vector<std::unique_ptr<int>> in;
+    for (int i {}; i < 4; ++i) { in.push_back(std::make_unique<int>(i)); }
+    q.push_bulk(std::make_move_iterator(in.begin()),
+                std::make_move_iterator(in.end()));
+    std::vector<std::unique_ptr<int>> out(4);
+    assert(q.try_pop_bulk(out.begin(), out.size()) == 4);
+    for (int i {}; i < 4; ++i) { assert(*out[i] == i); }
+  }
+
+  // Bulk operations copy large trivially copyable payloads directly
+  {
+    struct Large
+    {
+      std::array<std::uint64_t, 32> words;
+    };
+    dro::MPMC_Queue<Large, std::allocator<dro::Slot<Large>>,
+                    dro::PackedSlots>
+        q {16};
+    std::vector<Large> in(100);
+    for (std::size_t i {}; i < in.size(); ++i) { in[i].words.fill(i); }
+    auto thrd = std::thread([&] { q.push_bulk(in.begin(), in.end()); });
+    std::vector<Large> out;
+    q.pop_bulk(std::back_inserter(out), in.size());
+    thrd.join();
+    for (std::size_t i {}; i < out.size(); ++i)
+    {
+      assert(out[i].words.front() == i && out[i].words.back() == i);
+    }
+    std::vector<Large> const partial(in.begin(), in.begin() + 20);
+    assert(q.try_push_bulk(partial.begin(), partial.end()) == 16);
+    assert(q.try_pop_bulk(out.begin(), 20) == 16);
+    assert(out[15].words[7] == 15);
+  }
+
+  // Wait strategies
+  {
+    testWaitStrategy<dro::SpinWait>();
+    testWaitStrategy<dro::BackoffWait<>>();
+    testWaitStrategy<dro::YieldWait<>>();
+    testWaitStrategy<dro::BlockingWait<>>();
+    testWaitStrategy<dro::BlockingWait<0>>();
+  }
+
+  // Timed operations
+  {
+    using namespace std::chrono_literals;
+    dro::MPMC_Queue<int> q {1};
+    int t     = 0;
+    auto last = std::chrono::steady_clock::now();
+    assert(q.try_pop_for(t, 10ms) == false);
+    assert(std::chrono::steady_clock::now() - last >= 10ms);
+    assert(q.try_push_for(1, 10ms) == true);
+    last = std::chrono::steady_clock::now();
+    assert(q.try_push_until(2, last + 10ms) == false);
+    assert(std::chrono::steady_clock::now() >= last + 10ms);
+    assert(q.try_pop_until(t, std::chrono::steady_clock::now() + 10ms) ==
+               true &&
+           t == 1);
+    auto thrd = std::thread([&] {
+      std::this_thread::sleep_for(5ms);
+      q.push(3);
+    });
+    assert(q.try_pop_for(t, 10s) == true && t == 3);
+    thrd.join();
+  }
+
+  // Producer and consumer kinds
+  {
+    testProducerConsumerKind<dro::SingleProducer, dro::SingleConsumer>(1, 1);
+    testProducerConsumerKind<dro::SingleProducer, dro::MultiConsumer>(1, 2);
+    testProducerConsumerKind<dro::MultiProducer, dro::SingleConsumer>(2, 1);
+    testProducerConsumerKind<dro::MultiProducer, dro::MultiConsumer>(2, 2);
+
+    dro::MPMC_Queue<int, std::allocator<dro::Slot<int>>, dro::SingleProducer,
+                    dro::SingleConsumer>
+        q {4};
+    std::vector<int> in {1, 2, 3, 4, 5};
+    std::vector<int> out(5);
+    assert(q.try_push_bulk(in.begin(), in.end()) == 4);
+    assert(q.try_pop_bulk(out.begin(), 2) == 2);
+    q.push_bulk(in.begin(), in.begin() + 2);
+    q.pop_bulk(out.begin() + 2, 3);
+    assert(out[0] == 1 && out[1] == 2 && out[2] == 3 && out[3] == 4 &&
+           out[4] == 1);
+  }
+
+  // In place reserve / commit and acquire / release
+  {
+    struct Message
+    {
+      int id_ {};
+      char payload_[252] {};
+    };
+    dro::MPMC_Queue<Message> q {2};
+    auto producer = q.reserve();
+    producer->id_ = 1;
+    q.commit(producer);
+    auto next = q.try_reserve();
+    assert(next.has_value());
+    (*next)->id_ = 2;
+    q.commit(*next);
+    assert(! q.try_reserve().has_value());
+    auto consumer = q.acquire();
+    assert(consumer->id_ == 1);
+    q.release(consumer);
+    auto last = q.try_acquire();
+    assert(last.has_value() && (**last).id_ == 2);
+    q.release(*last);
+    assert(! q.try_acquire().has_value());
+
+    auto thrd = std::thread([&] {
+      for (int i {}; i < 100; ++i)
+      {
+        auto handle = q.reserve();
+        handle->id_ = i;
+        q.commit(handle);
+      }
+    });
+    for (int i {}; i < 100; ++i)
+    {
+      auto handle = q.acquire();
+      assert(handle->id_ == i);
+      q.release(handle);
+    }
+    thrd.join();
+  }
+
   // Copyable only type
   {
     struct Test
@@ -59,6 +400,20 @@ int main(int argc, char* argv[])
     q.try_push(std::make_unique<int>(1));
   }
 
+  // Elements left in the queue are destroyed exactly once
+  {
+    {
+      dro::MPMC_Queue<LiveCount> q {4};
+      assert(LiveCount::live == 4);
+      q.push(LiveCount(1));
+      q.push(LiveCount(2));
+      LiveCount t;
+      q.pop(t);
+      assert(t.value == 1 && LiveCount::live == 5);
+    }
+    assert(LiveCount::live == 0);
+  }
+
   {
     bool throws = false;
     try
@@ -72,6 +427,248 @@ int main(int argc, char* argv[])
     assert(throws == true);
   }
 
+  // Stats policy
+  {
+    using Queue = dro::MPMC_Queue<int, std::allocator<dro::Slot<int>>,
+                                  dro::ShardedStats<4>>;
+    Queue q(2);
+    int t = 0;
+    assert(q.try_pop(t) == false);
+    assert(q.try_push(1) == true && q.try_push(2) == true);
+    assert(q.try_push(3) == false);
+    q.pop(t);
+    assert(q.try_pop(t) == true && t == 2);
+    auto stats = q.stats();
+    assert(stats.try_push_successes == 2 && stats.try_push_failures == 1);
+    assert(stats.try_pop_successes == 1 && stats.try_pop_failures == 1);
+    assert(stats.high_water_mark == 2);
+    assert(stats.pop_spins == 0);
+
+    // The consumer spins until the producer pushes
+    std::atomic<bool> popped(false);
+    auto thrd = std::thread([&] {
+      int val = 0;
+      q.pop(val);
+      popped = true;
+    });
+    while (q.size() >= 0) { std::this_thread::yield(); }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    q.push(4);
+    thrd.join();
+    assert(popped == true);
+    stats = q.stats();
+    assert(stats.pop_spins > 0);
+    assert(stats.try_push_successes == 2 && stats.try_pop_successes == 1);
+
+    // Counters from several threads are summed over the shards
+    Queue q2(64);
+    std::vector<std::thread> threads;
+    for (int i {}; i < 8; ++i)
+    {
+      threads.emplace_back([&] {
+        for (int j {}; j < 100; ++j)
+        {
+          while (! q2.try_push(j)) { std::this_thread::yield(); }
+          int val = 0;
+          while (! q2.try_pop(val)) { std::this_thread::yield(); }
+        }
+      });
+    }
+    for (auto& thread : threads) { thread.join(); }
+    stats = q2.stats();
+    assert(stats.try_push_successes == 800 && stats.try_pop_successes == 800);
+    assert(stats.high_water_mark >= 1 && stats.high_water_mark <= 64);
+
+    // Disabled by default
+    dro::MPMC_Queue<int> q3(2);
+    assert(q3.try_push(1) == true);
+    assert(q3.stats().try_push_successes == 0);
+  }
+
+  // Occupancy
+  {
+    dro::MPMC_Queue<int> q(2);
+    int t = 0;
+    assert(q.occupancy() == 0 && q.empty() && ! q.full());
+    q.push(1);
+    assert(q.occupancy() == 1 && ! q.empty() && ! q.full());
+    q.push(2);
+    assert(q.occupancy() == 2 && q.full());
+    q.pop(t);
+    q.pop(t);
+    assert(q.occupancy() == 0 && q.empty());
+
+    // A waiting consumer makes the size negative, the occupancy stays zero
+    auto thrd = std::thread([&] {
+      int val = 0;
+      q.pop(val);
+    });
+    while (q.size() >= 0) { std::this_thread::yield(); }
+    assert(q.occupancy() == 0 && q.empty());
+    q.push(3);
+    thrd.join();
+
+    // The hint is refreshed every Interval tickets on each side
+    dro::MPMC_Queue<int, std::allocator<dro::Slot<int>>,
+                    dro::OccupancyHint<2>>
+        q2(8);
+    assert(q2.occupancy_hint() == 0);
+    q2.push(1);
+    assert(q2.occupancy_hint() == 0);
+    q2.push(2);
+    assert(q2.occupancy_hint() == 2);
+    q2.push(3);
+    assert(q2.try_push(4) == true);
+    assert(q2.occupancy_hint() == 4 && q2.occupancy() == 4);
+    q2.pop(t);
+    assert(q2.try_pop(t) == true);
+    assert(q2.occupancy_hint() == 2);
+  }
+
+  // Ticket prefetch, the prefetched tickets wrap past the capacity
+  {
+    testProducerConsumerKind<dro::TicketPrefetch<3>, dro::MultiConsumer>(2, 2);
+    dro::MPMC_Queue<int, std::allocator<dro::Slot<int>>, dro::SingleProducer,
+                    dro::SingleConsumer, dro::TicketPrefetch<>>
+        q(2);
+    int t = 0;
+    for (int i {}; i < 100; ++i)
+    {
+      assert(q.try_push(i) == true);
+      q.push(i + 1);
+      assert(q.try_pop(t) == true && t == i);
+      assert(q.pop(t) == true && t == i + 1);
+    }
+    auto producer = q.reserve();
+    *producer     = 7;
+    q.commit(producer);
+    auto consumer = q.acquire();
+    assert(*consumer == 7);
+    q.release(consumer);
+  }
+
+  // Ready slots, claimed tickets that are not published do not count
+  {
+    dro::MPMC_Queue<int> q(1);
+    assert(! q.front_ready() && q.back_ready());
+    auto producer = q.reserve();
+    assert(! q.empty() && ! q.front_ready() && ! q.back_ready());
+    q.commit(producer);
+    assert(q.front_ready() && ! q.back_ready());
+    auto consumer = q.acquire();
+    assert(! q.full() && ! q.front_ready() && ! q.back_ready());
+    q.release(consumer);
+    assert(! q.front_ready() && q.back_ready());
+    q.close();
+    assert(! q.front_ready() && ! q.back_ready());
+  }
+
+  // Close, pushes fail and pops drain the queue
+  {
+    dro::MPMC_Queue<int> q(4);
+    int t = 0;
+    assert(q.push(1) == true && q.push(2) == true);
+    assert(! q.closed() && ! q.drained());
+    q.close();
+    q.close();
+    assert(q.closed() && ! q.drained());
+    assert(q.push(3) == false && q.try_push(4) == false);
+    assert(q.size() == 2 && q.occupancy() == 2);
+    assert(q.pop(t) == true && t == 1);
+    assert(q.try_pop(t) == true && t == 2);
+    assert(q.drained() && q.empty());
+    assert(q.try_pop(t) == false && q.pop(t) == false && q.pop(t) == false);
+    assert(q.try_pop_for(t, std::chrono::hours(1)) == false);
+    assert(q.try_push_for(5, std::chrono::hours(1)) == false);
+    assert(q.occupancy() == 0 && q.empty());
+
+    // Bulk operations and in place handles
+    dro::MPMC_Queue<int> q2(4);
+    std::vector<int> in {1, 2};
+    std::vector<int> out(4);
+    assert(q2.push_bulk(in.begin(), in.end()) == true);
+    q2.close();
+    assert(q2.push_bulk(in.begin(), in.end()) == false);
+    assert(q2.try_push_bulk(in.begin(), in.end()) == 0);
+    assert(! q2.reserve() && ! q2.try_reserve().has_value());
+    assert(q2.pop_bulk(out.begin(), 4) == 2 && out[0] == 1 && out[1] == 2);
+    assert(q2.try_pop_bulk(out.begin(), 4) == 0);
+    assert(! q2.acquire() && ! q2.try_acquire().has_value());
+
+    dro::MPMC_Queue<int> q3(4);
+    assert(q3.push(1) == true && q3.push(2) == true);
+    q3.close();
+    assert(q3.try_pop_bulk(out.begin(), 4) == 2 && out[1] == 2);
+    assert(q3.try_pop_bulk(out.begin(), 4) == 0 && q3.drained());
+
+    // With a single producer the producer closes the queue
+    dro::MPMC_Queue<int, std::allocator<dro::Slot<int>>, dro::SingleProducer,
+                    dro::SingleConsumer>
+        q4(2);
+    assert(q4.push(1) == true);
+    q4.close();
+    assert(q4.push(2) == false);
+    assert(q4.pop(t) == true && t == 1 && q4.pop(t) == false);
+  }
+
+  // Close releases the consumers blocked in pop()
+  {
+    dro::MPMC_Queue<int, std::allocator<dro::Slot<int>>, dro::BlockingWait<>>
+        q(2);
+    std::atomic<int> released(0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 3; ++i)
+    {
+      threads.push_back(std::thread([&] {
+        int val = 0;
+        if (! q.pop(val))
+        {
+          released.fetch_add(1);
+        }
+      }));
+    }
+    while (q.size() > -3) { std::this_thread::yield(); }
+    q.close();
+    for (auto& thread : threads) { thread.join(); }
+    assert(released == 3 && q.empty());
+  }
+
+  // Contended try operations on a small queue, every try fails fast on a full
+  // or empty snapshot and retries on a stale one
+  {
+    const int numOps     = 10'000;
+    const int numThreads = 4;
+    dro::MPMC_Queue<int> q(2);
+    std::atomic<bool> flag(false);
+    std::atomic<long> sum(0);
+    std::vector<std::thread> threads;
+    for (int i {}; i < numThreads; ++i)
+    {
+      threads.emplace_back([&] {
+        while (! flag) {}
+        for (int j {}; j < numOps; ++j)
+        {
+          while (! q.try_push(j)) { std::this_thread::yield(); }
+        }
+      });
+      threads.emplace_back([&] {
+        while (! flag) {}
+        long local {};
+        int val {};
+        for (int j {}; j < numOps; ++j)
+        {
+          while (! q.try_pop(val)) { std::this_thread::yield(); }
+          local += val;
+        }
+        sum += local;
+      });
+    }
+    flag = true;
+    for (auto& thrd : threads) { thrd.join(); }
+    assert(sum == static_cast<long>(numThreads) * numOps * (numOps - 1) / 2);
+    assert(q.empty());
+  }
+
   // Fuzz test
   {
     const uint64_t numOps     = 1000;
@@ -106,5 +703,33 @@ int main(int argc, char* argv[])
     assert(sum == numOps * (numOps - 1) / 2);
   }
 
+  // Fuzz test, close while producers push, every accepted element is popped
+  {
+    const uint64_t numThreads = 4;
+    dro::MPMC_Queue<uint64_t> q {8};
+    std::atomic<uint64_t> pushed(0);
+    std::atomic<uint64_t> popped(0);
+    std::vector<std::thread> threads;
+    for (uint64_t i = 0; i < numThreads; ++i)
+    {
+      threads.push_back(std::thread([&, i] {
+        for (uint64_t j = 0; q.push(j); ++j)
+        {
+          pushed.fetch_add(1);
+          if (i == 0 && j == 100)
+          {
+            q.close();
+          }
+        }
+      }));
+      threads.push_back(std::thread([&] {
+        uint64_t v;
+        while (q.pop(v)) { popped.fetch_add(1); }
+      }));
+    }
+    for (auto& thread : threads) { thread.join(); }
+    assert(pushed == popped && pushed > 100 && q.drained());
+  }
+
   return 0;
 }
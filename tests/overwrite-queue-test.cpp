@@ -0,0 +1,84 @@
+#include "dro/overwrite-queue.hpp"
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+int main(int argc, char* argv[])
+{
+
+  // The producer never blocks, the oldest elements are dropped
+  {
+    dro::MPMC_OverwriteQueue<int> q {4};
+    assert(q.capacity() == 4 && q.empty());
+    int t = 0;
+    assert(q.try_pop(t) == false);
+    q.push(0);
+    q.emplace(1);
+    assert(q.size() == 2);
+    assert(q.try_pop(t) == true && t == 0);
+    assert(q.dropped() == 0);
+    for (int i = 2; i < 10; ++i) { q.push(i); }
+    assert(q.size() == 4);
+    assert(q.try_pop(t) == true && t == 6);
+    assert(q.dropped() == 5);
+    for (int i = 7; i < 10; ++i) { assert(q.try_pop(t) && t == i); }
+    assert(q.try_pop(t) == false && q.empty());
+  }
+
+  {
+    bool throws = false;
+    try
+    {
+      dro::MPMC_OverwriteQueue<int> q {0};
+    }
+    catch (const std::logic_error&)
+    {
+      throws = true;
+    }
+    assert(throws == true);
+  }
+
+  // Fuzz test, every element is either consumed once or dropped
+  {
+    const uint64_t numOps     = 100'000;
+    const uint64_t numThreads = 4;
+    dro::MPMC_OverwriteQueue<uint64_t> q {8};
+    auto seen = std::make_unique<std::atomic<bool>[]>(numOps);
+    std::atomic<uint64_t> consumed(0);
+    std::atomic<uint64_t> producing(numThreads);
+    std::vector<std::thread> threads;
+    for (uint64_t i = 0; i < numThreads; ++i)
+    {
+      threads.push_back(std::thread([&, i] {
+        for (auto j = i; j < numOps; j += numThreads) { q.push(j); }
+        producing.fetch_sub(1, std::memory_order_release);
+      }));
+      threads.push_back(std::thread([&] {
+        uint64_t t = 0;
+        while (true)
+        {
+          auto const finished = producing.load(std::memory_order_acquire) == 0;
+          if (q.try_pop(t))
+          {
+            assert(t < numOps && ! seen[t].exchange(true));
+            consumed.fetch_add(1, std::memory_order_relaxed);
+          }
+          else if (finished)
+          {
+            break;
+          }
+        }
+      }));
+    }
+    for (auto& thread : threads) { thread.join(); }
+    assert(consumed + q.dropped() == numOps && q.empty());
+  }
+
+  std::cout << "Test Completed!\n";
+  return 0;
+}
@@ -0,0 +1,99 @@
+#include "dro/pipeline.hpp"
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main(int argc, char* argv[])
+{
+
+  // Stages change the element type, stop() drains every stage
+  {
+    std::vector<std::string> out;
+    {
+      auto pipeline =
+          dro::Pipeline<int>::builder(4)
+              .stage(-1, [](int i) { return i * 2; })
+              .stage(-1, [](int i) { return std::to_string(i); })
+              .sink(-1, [&](std::string s) { out.push_back(std::move(s)); });
+      assert(pipeline.stage_count() == 3);
+      for (int i = 0; i < 100; ++i) { pipeline.push(i); }
+      pipeline.stop();
+      pipeline.stop();
+      auto const stats = pipeline.stats();
+      assert(stats.size() == 3);
+      for (auto const& stage : stats)
+      {
+        assert(stage.processed == 100 && stage.depth == 0);
+        assert(stage.batches >= 1 && stage.batches <= 100);
+      }
+    }
+    assert(out.size() == 100);
+    for (int i = 0; i < 100; ++i) { assert(out[i] == std::to_string(i * 2)); }
+  }
+
+  // The destructor drains, move only elements
+  {
+    int sum = 0;
+    {
+      auto pipeline =
+          dro::Pipeline<std::unique_ptr<int>, 4>::builder(2)
+              .stage(-1,
+                     [](std::unique_ptr<int> p) {
+                       ++*p;
+                       return p;
+                     })
+              .sink(-1, [&](std::unique_ptr<int> p) { sum += *p; });
+      for (int i = 0; i < 10; ++i)
+      {
+        pipeline.push(std::make_unique<int>(i));
+      }
+    }
+    assert(sum == 55);
+  }
+
+  {
+    bool throws = false;
+    try
+    {
+      auto builder = dro::Pipeline<int>::builder(0);
+    }
+    catch (const std::logic_error&)
+    {
+      throws = true;
+    }
+    assert(throws == true);
+  }
+
+  // Fuzz test, many producers into one pipeline
+  {
+    const uint64_t numOps     = 100'000;
+    const uint64_t numThreads = 4;
+    std::atomic<uint64_t> sum(0);
+    {
+      auto pipeline =
+          dro::Pipeline<uint64_t>::builder(8)
+              .stage(-1, [](uint64_t i) { return i + 1; })
+              .sink(-1, [&](uint64_t i) {
+                sum.fetch_add(i - 1, std::memory_order_relaxed);
+              });
+      std::vector<std::thread> threads;
+      for (uint64_t i = 0; i < numThreads; ++i)
+      {
+        threads.push_back(std::thread([&, i] {
+          for (auto j = i; j < numOps; j += numThreads) { pipeline.push(j); }
+        }));
+      }
+      for (auto& thread : threads) { thread.join(); }
+    }
+    assert(sum == numOps * (numOps - 1) / 2);
+  }
+
+  std::cout << "Test Completed!\n";
+  return 0;
+}
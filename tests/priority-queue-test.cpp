@@ -0,0 +1,115 @@
+#include "dro/priority-queue.hpp"
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+int main(int argc, char* argv[])
+{
+
+  {
+    dro::MPMC_PriorityQueue<int, 3> q {4};
+    assert(q.lane_count() == 3 && q.capacity() == 12);
+    int t = 0;
+    assert(q.try_pop(t) == false && q.empty());
+    q.push(2, 20);
+    q.push(1, 10);
+    q.push(2, 21);
+    q.push(0, 0);
+    assert(q.size() == 4);
+    // Highest priority lane first, FIFO within a lane
+    assert(q.try_pop(t) == true && t == 0);
+    assert(q.try_pop(t) == true && t == 10);
+    q.push(0, 1);
+    assert(q.try_pop(t) == true && t == 1);
+    assert(q.try_pop(t) == true && t == 20);
+    assert(q.try_pop(t) == true && t == 21);
+    assert(q.try_pop(t) == false && q.empty());
+    // Lanes fill independently
+    for (int i {}; i < 4; ++i) { assert(q.try_push(1, i) == true); }
+    assert(q.try_push(1, 4) == false);
+    assert(q.try_push(0, 5) == true);
+    assert(q.try_pop(t) == true && t == 5);
+    // A lane pushed directly is found once it is pushed through the queue
+    q.lane(2).push(7);
+    for (int i {}; i < 4; ++i)
+    {
+      assert(q.try_pop(t) == true && t == i);
+    }
+    q.push(2, 8);
+    assert(q.try_pop(t) == true && t == 7);
+    assert(q.try_pop(t) == true && t == 8);
+  }
+
+  {
+    dro::MPMC_PriorityQueue<std::unique_ptr<int>, 2> q {2};
+    q.emplace(1, std::make_unique<int>(1));
+    assert(q.try_emplace(0, std::make_unique<int>(0)) == true);
+    std::unique_ptr<int> t;
+    q.pop(t);
+    assert(t && *t == 0);
+    q.pop(t);
+    assert(t && *t == 1);
+    // Elements left in the queue are destroyed with it
+    q.push(1, std::make_unique<int>(2));
+  }
+
+  {
+    bool throws = false;
+    try
+    {
+      dro::MPMC_PriorityQueue<int, 2> q {0};
+    }
+    catch (std::exception&)
+    {
+      throws = true;
+    }
+    assert(throws == true);
+  }
+
+  // Fuzz test, every element pushed to a random lane is popped exactly once
+  // while consumers race to clear and set the lane bits
+  {
+    const uint64_t numOps     = 10'000;
+    const uint64_t numThreads = 4;
+    dro::MPMC_PriorityQueue<uint64_t, 4> q {16};
+    std::atomic<bool> flag(false);
+    std::vector<std::thread> threads;
+    std::atomic<uint64_t> sum(0);
+    for (uint64_t i = 0; i < numThreads; ++i)
+    {
+      threads.push_back(std::thread([&, i] {
+        while (! flag);
+        for (auto j = i; j < numOps; j += numThreads)
+        {
+          q.push((j / numThreads) % 4, j);
+        }
+      }));
+    }
+    for (uint64_t i = 0; i < numThreads; ++i)
+    {
+      threads.push_back(std::thread([&, i] {
+        while (! flag);
+        uint64_t threadSum = 0;
+        for (auto j = i; j < numOps; j += numThreads)
+        {
+          uint64_t v;
+          q.pop(v);
+          threadSum += v;
+        }
+        sum += threadSum;
+      }));
+    }
+    flag = true;
+    for (auto& thread : threads) { thread.join(); }
+    assert(sum == numOps * (numOps - 1) / 2);
+    uint64_t t;
+    assert(q.try_pop(t) == false);
+  }
+
+  std::cout << "Test Completed!\n";
+  return 0;
+}
@@ -0,0 +1,111 @@
+#include "dro/segmented-queue.hpp"
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+int main(int argc, char* argv[])
+{
+
+  {
+    dro::MPMC_SegmentedQueue<int> q {3};
+    assert(q.segment_capacity() == 4 && q.segment_count() == 1);
+    int t = 0;
+    assert(q.try_pop(t) == false);
+    // Wraps around the first segment while the backlog fits
+    for (int i {}; i < 100; ++i)
+    {
+      q.push(i);
+      assert(q.try_pop(t) == true && t == i);
+    }
+    assert(q.segment_count() == 1);
+    // Grows by one segment per full segment
+    for (int i {}; i < 40; ++i) { q.push(i); }
+    assert(q.segment_count() >= 10);
+    for (int i {}; i < 40; ++i)
+    {
+      assert(q.try_pop(t) == true && t == i);
+    }
+    assert(q.try_pop(t) == false);
+    // Drained segments are recycled, at most one is kept free
+    for (int i {}; i < 100; ++i)
+    {
+      q.push(i);
+      assert(q.try_pop(t) == true && t == i);
+    }
+    assert(q.segment_count() <= 3);
+  }
+
+  {
+    dro::MPMC_SegmentedQueue<std::unique_ptr<int>> q {2, 4};
+    for (int i {}; i < 16; ++i) { q.emplace(std::make_unique<int>(i)); }
+    std::unique_ptr<int> t;
+    for (int i {}; i < 16; ++i)
+    {
+      q.pop(t);
+      assert(t && *t == i);
+    }
+    // Elements left in the queue are destroyed with it
+    q.push(std::make_unique<int>(1));
+  }
+
+  {
+    bool throws = false;
+    try
+    {
+      dro::MPMC_SegmentedQueue<int> q {0};
+    }
+    catch (std::exception&)
+    {
+      throws = true;
+    }
+    assert(throws == true);
+  }
+
+  // Fuzz test, small segments so that segments are linked and retired while
+  // other threads use them
+  {
+    const uint64_t numOps     = 10'000;
+    const uint64_t numThreads = 4;
+    dro::MPMC_SegmentedQueue<uint64_t> q {8, 2};
+    std::atomic<bool> flag(false);
+    std::vector<std::thread> threads;
+    std::atomic<uint64_t> sum(0);
+    for (uint64_t i = 0; i < numThreads; ++i)
+    {
+      threads.push_back(std::thread([&, i] {
+        while (! flag);
+        for (auto j = i; j < numOps; j += numThreads) { q.push(j); }
+      }));
+    }
+    for (uint64_t i = 0; i < numThreads; ++i)
+    {
+      threads.push_back(std::thread([&, i] {
+        while (! flag);
+        uint64_t threadSum = 0;
+        // Elements of one producer arrive in order
+        std::vector<uint64_t> last(numThreads, UINT64_MAX);
+        for (auto j = i; j < numOps; j += numThreads)
+        {
+          uint64_t v;
+          q.pop(v);
+          auto& prev = last[v % numThreads];
+          assert(prev == UINT64_MAX || prev < v);
+          prev = v;
+          threadSum += v;
+        }
+        sum += threadSum;
+      }));
+    }
+    flag = true;
+    for (auto& thread : threads) { thread.join(); }
+    assert(sum == numOps * (numOps - 1) / 2);
+    uint64_t t;
+    assert(q.try_pop(t) == false);
+  }
+
+  return 0;
+}
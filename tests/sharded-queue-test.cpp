@@ -0,0 +1,91 @@
+#include "dro/sharded-queue.hpp"
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+int main(int argc, char* argv[])
+{
+
+  {
+    dro::MPMC_ShardedQueue<int> q {4, 2};
+    assert(q.shard_count() == 4 && q.capacity() == 8);
+    int t = 0;
+    assert(q.try_pop(t) == false);
+    // Spills over to the other shards when the home shard is full
+    for (int i {}; i < 8; ++i) { assert(q.try_push(i) == true); }
+    assert(q.try_push(8) == false);
+    assert(q.size() == 8 && ! q.empty());
+    int sum = 0;
+    for (int i {}; i < 8; ++i)
+    {
+      assert(q.try_pop(t) == true);
+      sum += t;
+    }
+    assert(sum == 28);
+    assert(q.try_pop(t) == false && q.empty());
+  }
+
+  // Elements pushed by one thread are popped in order
+  {
+    dro::MPMC_ShardedQueue<int> q {4, 16};
+    for (int i {}; i < 16; ++i) { q.push(i); }
+    for (int i {}; i < 16; ++i)
+    {
+      int t = -1;
+      q.pop(t);
+      assert(t == i);
+    }
+  }
+
+  {
+    bool throws = false;
+    try
+    {
+      dro::MPMC_ShardedQueue<int> q {0, 16};
+    }
+    catch (std::exception&)
+    {
+      throws = true;
+    }
+    assert(throws == true);
+  }
+
+  // Fuzz test
+  {
+    const uint64_t numOps     = 1000;
+    const uint64_t numThreads = 4;
+    dro::MPMC_ShardedQueue<uint64_t> q {numThreads, 8};
+    std::atomic<bool> flag(false);
+    std::vector<std::thread> threads;
+    std::atomic<uint64_t> sum(0);
+    for (uint64_t i = 0; i < numThreads; ++i)
+    {
+      threads.push_back(std::thread([&, i] {
+        while (! flag);
+        for (auto j = i; j < numOps; j += numThreads) { q.push(j); }
+      }));
+    }
+    for (uint64_t i = 0; i < numThreads; ++i)
+    {
+      threads.push_back(std::thread([&, i] {
+        while (! flag);
+        uint64_t threadSum = 0;
+        for (auto j = i; j < numOps; j += numThreads)
+        {
+          uint64_t v;
+          q.pop(v);
+          threadSum += v;
+        }
+        sum += threadSum;
+      }));
+    }
+    flag = true;
+    for (auto& thread : threads) { thread.join(); }
+    assert(sum == numOps * (numOps - 1) / 2);
+  }
+
+  return 0;
+}
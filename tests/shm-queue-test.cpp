@@ -0,0 +1,124 @@
+#include "dro/shm-queue.hpp"
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <sys/wait.h>
+#include <system_error>
+#include <unistd.h>
+
+struct Quote
+{
+  std::uint64_t id_ {};
+  double price_ {};
+};
+
+int main(int argc, char* argv[])
+{
+
+  auto const name = "/dro-shm-queue-test-" + std::to_string(::getpid());
+
+  {
+    dro::MPMC_ShmQueue<int> q {dro::shm_create, name, 3};
+    dro::MPMC_ShmQueue<int> view {dro::shm_attach, name};
+    assert(q.capacity() == 3 && view.capacity() == 3);
+    int t = 0;
+    assert(view.try_pop(t) == false);
+    for (int i {}; i < 3; ++i) { assert(q.try_push(i) == true); }
+    assert(view.try_push(3) == false);
+    assert(view.size() == 3 && ! q.empty());
+    for (int i {}; i < 3; ++i)
+    {
+      assert(view.try_pop(t) == true && t == i);
+    }
+    // Wraps around the ring through both mappings
+    for (int i {}; i < 100; ++i)
+    {
+      view.push(i);
+      q.pop(t);
+      assert(t == i);
+    }
+    assert(q.empty() && view.empty());
+
+    // The name exists until it is unlinked
+    bool throws = false;
+    try
+    {
+      dro::MPMC_ShmQueue<int> other {dro::shm_create, name, 3};
+    }
+    catch (const std::system_error&)
+    {
+      throws = true;
+    }
+    assert(throws == true);
+
+    // A different element type is rejected
+    throws = false;
+    try
+    {
+      dro::MPMC_ShmQueue<Quote> wrong {dro::shm_attach, name};
+    }
+    catch (const std::runtime_error&)
+    {
+      throws = true;
+    }
+    assert(throws == true);
+    dro::MPMC_ShmQueue<int>::unlink(name);
+  }
+
+  {
+    bool throws = false;
+    try
+    {
+      dro::MPMC_ShmQueue<int> q {dro::shm_attach, name};
+    }
+    catch (const std::system_error&)
+    {
+      throws = true;
+    }
+    assert(throws == true);
+
+    throws = false;
+    try
+    {
+      dro::MPMC_ShmQueue<int> q {0};
+    }
+    catch (const std::logic_error&)
+    {
+      throws = true;
+    }
+    assert(throws == true);
+  }
+
+  // A memfd queue shared with a child process, the child pushes and the
+  // parent pops
+  {
+    const std::uint64_t numOps = 10'000;
+    dro::MPMC_ShmQueue<Quote> q {64};
+    auto const child = ::fork();
+    assert(child >= 0);
+    if (child == 0)
+    {
+      dro::MPMC_ShmQueue<Quote> producer {dro::shm_attach, q.fd()};
+      for (std::uint64_t i {}; i < numOps; ++i)
+      {
+        producer.push(Quote {i, static_cast<double>(i) / 2});
+      }
+      ::_exit(0);
+    }
+    Quote t;
+    for (std::uint64_t i {}; i < numOps; ++i)
+    {
+      q.pop(t);
+      assert(t.id_ == i && t.price_ == static_cast<double>(i) / 2);
+    }
+    int status = 0;
+    assert(::waitpid(child, &status, 0) == child);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    assert(q.try_pop(t) == false);
+  }
+
+  std::cout << "Test Completed!\n";
+  return 0;
+}
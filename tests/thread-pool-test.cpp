@@ -0,0 +1,146 @@
+#include "dro/pin-thread.hpp"
+#include "dro/thread-pool.hpp"
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+// Each task submits two children until the depth is reached, from the
+// workers so the tasks start in the local queues and are stolen
+template <typename Pool>
+void spawn(Pool& pool, std::atomic<uint64_t>& count, int depth)
+{
+  count.fetch_add(1, std::memory_order_relaxed);
+  if (depth == 0)
+  {
+    return;
+  }
+  for (int i {}; i < 2; ++i)
+  {
+    pool.submit([&pool, &count, depth] { spawn(pool, count, depth - 1); });
+  }
+}
+
+void waitFor(std::atomic<uint64_t>& count, uint64_t n)
+{
+  while (count.load(std::memory_order_acquire) < n)
+  {
+    std::this_thread::yield();
+  }
+}
+
+template <typename Wait> void testThreadPool()
+{
+  using Pool = dro::ThreadPool<Wait>;
+  // Submissions from several external threads through the global queue
+  {
+    const uint64_t numOps     = 10'000;
+    const uint64_t numThreads = 2;
+    std::atomic<uint64_t> sum(0);
+    std::atomic<uint64_t> count(0);
+    Pool pool {4, 64};
+    assert(pool.thread_count() == 4);
+    std::vector<std::thread> threads;
+    for (uint64_t i = 0; i < numThreads; ++i)
+    {
+      threads.push_back(std::thread([&, i] {
+        for (auto j = i; j < numOps; j += numThreads)
+        {
+          pool.submit([&sum, &count, j] {
+            sum.fetch_add(j, std::memory_order_relaxed);
+            count.fetch_add(1, std::memory_order_release);
+          });
+        }
+      }));
+    }
+    for (auto& thread : threads) { thread.join(); }
+    waitFor(count, numOps);
+    assert(sum == numOps * (numOps - 1) / 2);
+  }
+  // Nested submissions overflow the small local queues into the global queue
+  // and run inline once both are full
+  {
+    std::atomic<uint64_t> count(0);
+    Pool pool {3, 8};
+    pool.submit([&] { spawn(pool, count, 12); });
+    waitFor(count, (uint64_t {1} << 13) - 1);
+    assert(count == (uint64_t {1} << 13) - 1);
+  }
+}
+
+int main(int argc, char* argv[])
+{
+
+  testThreadPool<dro::SpinWait>();
+  testThreadPool<dro::YieldWait<>>();
+  testThreadPool<dro::BlockingWait<>>();
+
+  // Tasks are stored in place and moved through the slots
+  {
+    using Task = dro::ThreadPool<>::task_type;
+    static_assert(sizeof(dro::Slot<Task>) == dro::cacheLineSize);
+    int calls = 0;
+    auto ptr  = std::make_unique<int>(5);
+    Task task([&calls, p = std::move(ptr)] { calls += *p; });
+    Task moved;
+    assert(! moved);
+    moved = std::move(task);
+    assert(! task && moved);
+    moved();
+    assert(calls == 5);
+    moved.reset();
+    assert(! moved);
+  }
+
+  // Queued tasks run before the destructor returns
+  {
+    std::atomic<uint64_t> count(0);
+    {
+      dro::ThreadPool<> pool {2, 256};
+      for (int i {}; i < 200; ++i)
+      {
+        pool.submit([&count] { count.fetch_add(1); });
+      }
+    }
+    assert(count == 200);
+  }
+
+  // Pinning
+  {
+    dro::pinThread(-1);
+    dro::pinThread(0);
+    std::atomic<uint64_t> count(0);
+    dro::ThreadPool<> pool {2, 16, {0}};
+    pool.submit([&count] { count.fetch_add(1); });
+    waitFor(count, 1);
+
+    bool throws = false;
+    try
+    {
+      dro::ThreadPool<> invalid {2, 16, {1000}};
+    }
+    catch (const std::system_error&)
+    {
+      throws = true;
+    }
+    assert(throws == true);
+
+    throws = false;
+    try
+    {
+      dro::ThreadPool<> empty {0};
+    }
+    catch (const std::logic_error&)
+    {
+      throws = true;
+    }
+    assert(throws == true);
+  }
+
+  std::cout << "Test Completed!\n";
+  return 0;
+}